@@ -0,0 +1,238 @@
+#pragma once
+
+//
+// Collects items from many threads and hands them to one consumer thread in batches.
+// Each producer fills its own batch under a lock no other producer takes; full batches go through a lock-free
+// bounded queue to the consumer, which calls the sink for each item in order. The consumer also empties
+// batches that have held items too long, so rare items show up promptly even if their producer adds no more.
+// Producers never wait on the sink, so slow output like a console doesn't serialize the threads producing it.
+// Stop() must be called after every producer is done; it drains the queue and all partially filled batches.
+//
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+
+#include <djl_mpmc.hxx>
+
+template <class T> class CBatchCollector
+{
+    private:
+        struct Batch
+        {
+            std::mutex mtx;                                  // held by the producer adding and the consumer sweeping
+            std::vector<T> items;
+            std::chrono::steady_clock::time_point started;   // when the oldest item was added
+        };
+
+        // a thread's current batch, tagged with the run it belongs to so a later Start() doesn't reuse it
+
+        struct ThreadBatch
+        {
+            uint64_t run;
+            Batch * batch;
+        };
+
+        static const size_t batchSize = 256;
+        static const int maxBatchAgeMS = 250;   // so results show up promptly even when they're rare
+
+        CBoundedQueue<Batch *> full;
+        std::mutex mtx;                          // guards partial, which changes once per batch
+        std::vector<Batch *> partial;            // every thread's current batch
+        std::function<void( T & )> sink;
+        std::thread consumer;
+        std::atomic<bool> stopping;
+        uint64_t run;
+
+        static uint64_t NextRun()
+        {
+            static std::atomic<uint64_t> runs( 0 );
+            return ++runs;
+        } //NextRun
+
+        static ThreadBatch & Current()
+        {
+            static thread_local ThreadBatch tb = { 0, 0 };
+            return tb;
+        } //Current
+
+        void Consume( Batch * b )
+        {
+            for ( size_t i = 0; i < b->items.size(); i++ )
+                sink( b->items[ i ] );
+            b->items.clear();
+        } //Consume
+
+        // takes the items from partial batches that are older than maxBatchAgeMS
+
+        void Sweep()
+        {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            int maxAge = maxBatchAgeMS;
+            std::vector<T> stale;
+
+            {
+                std::lock_guard<std::mutex> lock( mtx );
+                for ( size_t i = 0; i < partial.size(); i++ )
+                {
+                    Batch * b = partial[ i ];
+                    std::lock_guard<std::mutex> batchLock( b->mtx );
+                    if ( !b->items.empty() && ( now - b->started ) > std::chrono::milliseconds( maxAge ) )
+                    {
+                        stale.insert( stale.end(), b->items.begin(), b->items.end() );
+                        b->items.clear();
+                    }
+                }
+            }
+
+            for ( size_t i = 0; i < stale.size(); i++ )
+                sink( stale[ i ] );
+        } //Sweep
+
+        void ConsumerLoop()
+        {
+            unsigned idle = 0;
+            std::chrono::steady_clock::time_point lastSweep = std::chrono::steady_clock::now();
+            int sweepInterval = maxBatchAgeMS / 4;
+
+            do
+            {
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                if ( ( now - lastSweep ) > std::chrono::milliseconds( sweepInterval ) )
+                {
+                    Sweep();
+                    lastSweep = now;
+                }
+
+                Batch * b;
+                if ( full.TryPop( b ) )
+                {
+                    Consume( b );
+
+                    // the producer that sent it has moved on to a new batch
+
+                    delete b;
+                    idle = 0;
+                }
+                else if ( stopping )
+                    break;
+                else if ( idle++ < 64 )
+                    std::this_thread::yield();
+                else
+                    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+            } while ( true );
+        } //ConsumerLoop
+
+        Batch * NewBatch()
+        {
+            Batch * b = new Batch();
+            b->items.reserve( batchSize );
+
+            std::lock_guard<std::mutex> lock( mtx );
+            partial.push_back( b );
+            return b;
+        } //NewBatch
+
+        void Ship( Batch * b )
+        {
+            {
+                std::lock_guard<std::mutex> lock( mtx );
+                for ( size_t i = 0; i < partial.size(); i++ )
+                {
+                    if ( b == partial[ i ] )
+                    {
+                        partial[ i ] = partial.back();
+                        partial.pop_back();
+                        break;
+                    }
+                }
+            }
+
+            unsigned attempt = 0;
+            while ( !full.TryPush( b ) )
+            {
+                if ( attempt++ < 64 )
+                    std::this_thread::yield();
+                else
+                    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+            }
+        } //Ship
+
+    public:
+        CBatchCollector() : full( 1024 ), stopping( false ), run( 0 ) {}
+        ~CBatchCollector() { Stop(); }
+
+        // starts the consumer thread, which calls s for every item added until Stop()
+
+        void Start( std::function<void( T & )> s )
+        {
+            sink = s;
+            run = NextRun();
+            stopping = false;
+            consumer = std::thread( [this] () { ConsumerLoop(); } );
+        } //Start
+
+        void Add( const T & item )
+        {
+            ThreadBatch & tb = Current();
+            if ( run != tb.run || 0 == tb.batch )
+            {
+                tb.run = run;
+                tb.batch = NewBatch();
+            }
+
+            // copies, since binding a static const member to a reference would need a definition
+
+            size_t maxItems = batchSize;
+            int maxAge = maxBatchAgeMS;
+            Batch * b = tb.batch;
+            bool ship;
+
+            {
+                std::lock_guard<std::mutex> lock( b->mtx );
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                if ( b->items.empty() )
+                    b->started = now;
+
+                b->items.push_back( item );
+                ship = ( b->items.size() >= maxItems || ( now - b->started ) > std::chrono::milliseconds( maxAge ) );
+            }
+
+            if ( ship )
+            {
+                tb.batch = 0;
+                Ship( b );
+            }
+        } //Add
+
+        // call once every producer has finished. Items are passed to the sink before this returns.
+
+        void Stop()
+        {
+            if ( !consumer.joinable() )
+                return;
+
+            stopping = true;
+            consumer.join();
+
+            Batch * b;
+            while ( full.TryPop( b ) )
+            {
+                Consume( b );
+                delete b;
+            }
+
+            for ( size_t i = 0; i < partial.size(); i++ )
+            {
+                Consume( partial[ i ] );
+                delete partial[ i ];
+            }
+
+            partial.clear();
+            run = 0;
+        } //Stop
+}; //CBatchCollector
+
@@ -0,0 +1,118 @@
+#pragma once
+
+//
+// A pool of page-aligned I/O buffers of one size. Buffers are allocated on demand, returned to the pool
+// when released, and freed when the pool is destroyed, so steady state does no allocations. Page alignment
+// lets the kernel copy a page at a time and keeps vector loads from splitting cache lines.
+//
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+#include <mutex>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+class CBufferPool
+{
+    private:
+        std::mutex mtx;
+        std::vector<uint8_t *> available;
+        std::vector<uint8_t *> allocated;
+        size_t bufferSize;
+
+        static uint8_t * AlignedAlloc( size_t cb )
+        {
+#ifdef _WIN32
+            return (uint8_t *) _aligned_malloc( cb, PageSize );
+#else
+            void * p = 0;
+            if ( 0 != posix_memalign( &p, PageSize, cb ) )
+                return 0;
+            return (uint8_t *) p;
+#endif
+        } //AlignedAlloc
+
+        static void AlignedFree( uint8_t * p )
+        {
+#ifdef _WIN32
+            _aligned_free( p );
+#else
+            free( p );
+#endif
+        } //AlignedFree
+
+    public:
+        static const size_t PageSize = 4096;
+
+        CBufferPool() : bufferSize( 0 ) {}
+        ~CBufferPool() { Clear(); }
+
+        // frees every buffer; none may be in use
+
+        void Clear()
+        {
+            lock_guard<mutex> lock( mtx );
+
+            for ( size_t i = 0; i < allocated.size(); i++ )
+                AlignedFree( allocated[ i ] );
+
+            allocated.resize( 0 );
+            available.resize( 0 );
+        } //Clear
+
+        // cb is rounded up to a whole number of pages. Call before the first Get().
+
+        void SetBufferSize( size_t cb )
+        {
+            Clear();
+            bufferSize = round_up( get_max( cb, (size_t) 1 ), PageSize );
+        } //SetBufferSize
+
+        size_t BufferSize() { return bufferSize; }
+
+        // returns 0 if memory is exhausted
+
+        uint8_t * Get()
+        {
+            lock_guard<mutex> lock( mtx );
+
+            if ( !available.empty() )
+            {
+                uint8_t * p = available.back();
+                available.pop_back();
+                return p;
+            }
+
+            uint8_t * p = AlignedAlloc( bufferSize );
+            if ( 0 != p )
+                allocated.push_back( p );
+            return p;
+        } //Get
+
+        void Put( uint8_t * p )
+        {
+            if ( 0 == p )
+                return;
+
+            lock_guard<mutex> lock( mtx );
+            available.push_back( p );
+        } //Put
+}; //CBufferPool
+
+// Returns a buffer to its pool when it goes out of scope
+
+class CPooledBuffer
+{
+    private:
+        CBufferPool & pool;
+        uint8_t * p;
+
+    public:
+        CPooledBuffer( CBufferPool & bufferPool ) : pool( bufferPool ), p( bufferPool.Get() ) {}
+        ~CPooledBuffer() { pool.Put( p ); }
+        uint8_t * Get() { return p; }
+}; //CPooledBuffer
+
@@ -0,0 +1,93 @@
+#pragma once
+
+//
+// A lock-free latency histogram. Buckets are log-linear: 8 per power of two, so any recorded value is within
+// 12.5% of the bucket it lands in, from 1 nanosecond up to minutes, in a fixed 4KB of counters.
+// Record() is one relaxed atomic increment, so many threads can share one histogram.
+//
+
+#include <stdint.h>
+#include <atomic>
+
+class CLatencyHistogram
+{
+    private:
+        static const int subBits = 3;
+        static const int subBuckets = 1 << subBits;
+        static const int bucketCount = 64 * subBuckets;
+
+        std::atomic<uint64_t> buckets[ bucketCount ];
+        std::atomic<uint64_t> count;
+
+        static int HighBit( uint64_t x )
+        {
+            int bit = 0;
+            while ( x >>= 1 )
+                bit++;
+            return bit;
+        } //HighBit
+
+        static int BucketOf( uint64_t ns )
+        {
+            if ( ns < subBuckets )
+                return (int) ns;
+
+            int high = HighBit( ns );
+            int sub = (int) ( ( ns >> ( high - subBits ) ) & ( subBuckets - 1 ) );
+            return ( high - subBits + 1 ) * subBuckets + sub;
+        } //BucketOf
+
+        // the smallest value that lands in bucket b
+
+        static uint64_t LowerBound( int b )
+        {
+            if ( b < subBuckets )
+                return b;
+
+            int high = b / subBuckets + subBits - 1;
+            uint64_t sub = b % subBuckets;
+            return ( ( (uint64_t) subBuckets + sub ) << ( high - subBits ) );
+        } //LowerBound
+
+    public:
+        CLatencyHistogram() { Clear(); }
+
+        void Clear()
+        {
+            for ( int b = 0; b < bucketCount; b++ )
+                buckets[ b ].store( 0, std::memory_order_relaxed );
+            count.store( 0, std::memory_order_relaxed );
+        } //Clear
+
+        void Record( long long ns )
+        {
+            buckets[ BucketOf( ( ns < 0 ) ? 0 : (uint64_t) ns ) ].fetch_add( 1, std::memory_order_relaxed );
+            count.fetch_add( 1, std::memory_order_relaxed );
+        } //Record
+
+        uint64_t Count() { return count.load( std::memory_order_relaxed ); }
+
+        // fraction is 0..1, e.g. 0.99. Returns the lower bound of the bucket holding that percentile, or 0 if empty.
+
+        uint64_t Percentile( double fraction )
+        {
+            uint64_t total = Count();
+            if ( 0 == total )
+                return 0;
+
+            uint64_t target = (uint64_t) ( fraction * (double) total );
+            if ( target >= total )
+                target = total - 1;
+
+            uint64_t seen = 0;
+            for ( int b = 0; b < bucketCount; b++ )
+            {
+                seen += buckets[ b ].load( std::memory_order_relaxed );
+                if ( seen > target )
+                    return LowerBound( b );
+            }
+
+            return LowerBound( bucketCount - 1 );
+        } //Percentile
+}; //CLatencyHistogram
+
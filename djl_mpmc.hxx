@@ -0,0 +1,105 @@
+#pragma once
+
+//
+// Bounded multi-producer multi-consumer lock-free queue, based on Dmitry Vyukov's design.
+// Each cell carries a sequence number that tells producers and consumers whether it's their turn,
+// so the only shared writes are one CAS on the enqueue or dequeue position per operation.
+// TryPush and TryPop never block; callers decide how to wait.
+//
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+template <class T> class CBoundedQueue
+{
+    private:
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            T data;
+        };
+
+        std::unique_ptr<Cell[]> cells;
+        size_t mask;
+
+        // keep producers and consumers off each other's cache lines
+
+        alignas( 64 ) std::atomic<size_t> enqueuePos;
+        alignas( 64 ) std::atomic<size_t> dequeuePos;
+
+    public:
+        // capacity is rounded up to a power of 2
+
+        CBoundedQueue( size_t capacity ) : enqueuePos( 0 ), dequeuePos( 0 )
+        {
+            size_t size = 2;
+            while ( size < capacity )
+                size <<= 1;
+
+            cells.reset( new Cell[ size ] );
+            mask = size - 1;
+
+            for ( size_t i = 0; i < size; i++ )
+                cells[ i ].sequence.store( i, std::memory_order_relaxed );
+        } //CBoundedQueue
+
+        // returns false if the queue is full
+
+        bool TryPush( T const & data )
+        {
+            Cell * cell;
+            size_t pos = enqueuePos.load( std::memory_order_relaxed );
+
+            do
+            {
+                cell = & cells[ pos & mask ];
+                size_t seq = cell->sequence.load( std::memory_order_acquire );
+                intptr_t dif = (intptr_t) seq - (intptr_t) pos;
+
+                if ( 0 == dif )
+                {
+                    if ( enqueuePos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+                        break;
+                }
+                else if ( dif < 0 )
+                    return false;
+                else
+                    pos = enqueuePos.load( std::memory_order_relaxed );
+            } while ( true );
+
+            cell->data = data;
+            cell->sequence.store( pos + 1, std::memory_order_release );
+            return true;
+        } //TryPush
+
+        // returns false if the queue is empty
+
+        bool TryPop( T & data )
+        {
+            Cell * cell;
+            size_t pos = dequeuePos.load( std::memory_order_relaxed );
+
+            do
+            {
+                cell = & cells[ pos & mask ];
+                size_t seq = cell->sequence.load( std::memory_order_acquire );
+                intptr_t dif = (intptr_t) seq - (intptr_t) ( pos + 1 );
+
+                if ( 0 == dif )
+                {
+                    if ( dequeuePos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+                        break;
+                }
+                else if ( dif < 0 )
+                    return false;
+                else
+                    pos = dequeuePos.load( std::memory_order_relaxed );
+            } while ( true );
+
+            data = cell->data;
+            cell->sequence.store( pos + mask + 1, std::memory_order_release );
+            return true;
+        } //TryPop
+}; //CBoundedQueue
+
@@ -6,6 +6,8 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #ifdef _WIN32
@@ -19,6 +21,7 @@
     #include <direct.h>
     #include <intrin.h>
     #include <io.h>
+    #include <wctype.h>
 
     #define not_inlined __declspec(noinline)
     #define force_inlined __forceinline
@@ -123,6 +126,12 @@
 
     inline char * _strlwr( char * s ) { return strlwr( s ); }
 
+    struct FILETIME
+    {
+        uint32_t dwLowDateTime;
+        uint32_t dwHighDateTime;
+    };
+
     inline void sleep_ms( uint64_t ms )
     {
         uint64_t total_ns = ms * 1000000;
@@ -149,6 +158,44 @@
 
 #endif
 
+// Paths are in the native character set of the file system: UTF-16 on Windows and bytes (usually UTF-8) elsewhere
+
+#ifdef _WIN32
+
+    typedef WCHAR pathchar;
+    #define PATH_TEXT( x ) L##x
+    #define PATH_FMT "%ws"
+    #define PATH_SEP L'\\'
+
+    inline size_t path_len( const pathchar * p ) { return wcslen( p ); }
+    inline int path_cmp( const pathchar * a, const pathchar * b ) { return wcscmp( a, b ); }
+    inline const pathchar * path_rchr( const pathchar * p, pathchar c ) { return wcsrchr( p, c ); }
+    inline unsigned long long path_to_ull( const pathchar * p ) { return wcstoull( p, 0, 10 ); }
+    inline pathchar path_lower( pathchar c ) { return (pathchar) towlower( c ); }
+
+#else
+
+    typedef char pathchar;
+    #define PATH_TEXT( x ) x
+    #define PATH_FMT "%s"
+    #define PATH_SEP '/'
+
+    inline size_t path_len( const pathchar * p ) { return strlen( p ); }
+    inline int path_cmp( const pathchar * a, const pathchar * b ) { return strcmp( a, b ); }
+    inline const pathchar * path_rchr( const pathchar * p, pathchar c ) { return strrchr( p, c ); }
+    inline unsigned long long path_to_ull( const pathchar * p ) { return strtoull( p, 0, 10 ); }
+    inline pathchar path_lower( pathchar c ) { return (pathchar) tolower( (unsigned char) c ); } // bytes of UTF-8 are negative with -fsigned-char
+
+#endif
+
+inline pathchar * path_dup( const pathchar * p )
+{
+    size_t len = 1 + path_len( p );
+    pathchar * pdup = new pathchar[ len ];
+    memcpy( pdup, p, len * sizeof( pathchar ) );
+    return pdup;
+} //path_dup
+
 template <class T> inline T get_max( T a, T b )
 {
     if ( a > b )
@@ -5,24 +5,29 @@
 //
 
 #include <djltrace.hxx>
-#include <djlimagedata.hxx>
 #include <djltimed.hxx>
 
 #include <random>
+#include <vector>
+#include <mutex>
+
+#ifdef _WIN32
+#include <djlimagedata.hxx>
 #include <ppl.h>
 
 using namespace concurrency;
+#endif
 
 class CPathArray
 {
     public:
         struct PathItem
         {
-            WCHAR * pwcPath;
+            pathchar * pwcPath;
             FILETIME ftCreation;
             FILETIME ftLastWrite;
             FILETIME ftCapture;
-            ULONG ulAttribute;     // can be used to sort on anything, e.g. primary color
+            uint32_t ulAttribute;    // can be used to sort on anything, e.g. primary color
         };
 
     private:
@@ -32,13 +37,10 @@ class CPathArray
 
         static int CompareFT( FILETIME & ftA, FILETIME & ftB )
         {
-            ULARGE_INTEGER ulA, ulB;
-            ulA.LowPart = ftA.dwLowDateTime;
-            ulA.HighPart = ftA.dwHighDateTime;
-            ulB.LowPart = ftB.dwLowDateTime;
-            ulB.HighPart = ftB.dwHighDateTime;
+            uint64_t ulA = ( ( (uint64_t) ftA.dwHighDateTime ) << 32 ) | ftA.dwLowDateTime;
+            uint64_t ulB = ( ( (uint64_t) ftB.dwHighDateTime ) << 32 ) | ftB.dwLowDateTime;
 
-            return ( ulA.QuadPart > ulB.QuadPart ) ? 1 : ( ulA.QuadPart < ulB.QuadPart ) ? -1 : 0;
+            return ( ulA > ulB ) ? 1 : ( ulA < ulB ) ? -1 : 0;
         } //CompareFT
 
         static int PIAttributeCompare( const void * a, const void * b )
@@ -73,12 +75,18 @@ class CPathArray
             return CompareFT( pa->ftCapture, pb->ftCapture );
         } //PICaptureCompare
         
+        // ties are broken on ulAttribute so duplicate paths come out in a predictable order
+
         static int PIPathCompare( const void * a, const void * b )
         {
             PathItem *pa = (PathItem *) a;
             PathItem *pb = (PathItem *) b;
 
-            return wcscmp( pa->pwcPath, pb->pwcPath );
+            int cmp = path_cmp( pa->pwcPath, pb->pwcPath );
+            if ( 0 != cmp )
+                return cmp;
+
+            return PIAttributeCompare( a, b );
         } //PIPathCompare
 
         static int PIAttributeCompareDescending( const void * a, const void * b )
@@ -106,6 +114,7 @@ class CPathArray
             return PIPathCompare( b, a );
         } //PIPathCompareDescendingDescending
 
+#ifdef _WIN32
         void PrintList()
         {
             for ( size_t i = 0; i < Count(); i++ )
@@ -132,6 +141,7 @@ class CPathArray
                 tracer.Trace( "    Capture:    %2d-%02d-%04d %2d:%02d:%02d == %#llx\n", st.wMonth, st.wDay, st.wYear, st.wHour, st.wMinute, st.wSecond, uli.QuadPart );
             }
         } //PrintList
+#endif
         
     public:
         CPathArray() :
@@ -145,7 +155,7 @@ class CPathArray
         }
 
         size_t Count() { return elements.size(); }
-        WCHAR * Get( size_t i ) { return elements[ i ].pwcPath; }
+        pathchar * Get( size_t i ) { return elements[ i ].pwcPath; }
         PathItem & GetPathItem( size_t i ) { return elements[ i ]; }
         PathItem & operator[] ( size_t i ) { return elements[ i ]; }
 
@@ -153,7 +163,7 @@ class CPathArray
         {
             for ( size_t i = 0; i < elements.size(); i++ )
             {
-                delete elements[ i ].pwcPath;
+                delete [] elements[ i ].pwcPath;
                 elements[ i ].pwcPath = NULL;
             }
 
@@ -180,24 +190,25 @@ class CPathArray
 
         void SortOnAttribute( bool ascending = true )
         {
-            qsort( elements.data(), elements.size(), sizeof PathItem, ascending ? PIAttributeCompare : PIAttributeCompareDescending );
+            qsort( elements.data(), elements.size(), sizeof( PathItem ), ascending ? PIAttributeCompare : PIAttributeCompareDescending );
         } //SortOnAttribute
 
         void SortOnLastWrite( bool ascending = true )
         {
-            qsort( elements.data(), elements.size(), sizeof PathItem, ascending ? PILastWriteCompare : PILastWriteCompareDescending );
+            qsort( elements.data(), elements.size(), sizeof( PathItem ), ascending ? PILastWriteCompare : PILastWriteCompareDescending );
         } //SortOnLastWrite
 
         void SortOnCreation( bool ascending = true )
         {
-            qsort( elements.data(), elements.size(), sizeof PathItem, ascending ? PICreationCompare : PICreationCompareDescending );
+            qsort( elements.data(), elements.size(), sizeof( PathItem ), ascending ? PICreationCompare : PICreationCompareDescending );
         } //SortOnCreation
 
         void SortOnPath( bool ascending = true )
         {
-            qsort( elements.data(), elements.size(), sizeof PathItem, ascending ? PIPathCompare : PIPathCompareDescending );
+            qsort( elements.data(), elements.size(), sizeof( PathItem ), ascending ? PIPathCompare : PIPathCompareDescending );
         } //SortOnPath
 
+#ifdef _WIN32
         void SortOnCapture( bool ascending = true )
         {
             if ( !captureTimesLoaded )
@@ -240,10 +251,11 @@ class CPathArray
                 captureTimesLoaded = true;
             }
 
-            qsort( elements.data(), elements.size(), sizeof PathItem, ascending ? PICaptureCompare : PICaptureCompareDescending );
+            qsort( elements.data(), elements.size(), sizeof( PathItem ), ascending ? PICaptureCompare : PICaptureCompareDescending );
             tracer.Trace( "sorted on capture time, ascending %d\n", ascending );
             PrintList();
         } //SortOnCapture
+#endif
 
         void InvertSort()
         {
@@ -254,36 +266,42 @@ class CPathArray
                 swap( elements[ t++ ], elements[ b-- ] );
         } //InvertSort
 
-        void Add( WCHAR * pwc, FILETIME & creation, FILETIME & lastWrite )
+        void Add( const pathchar * pwc, FILETIME & creation, FILETIME & lastWrite )
         {
-            PathItem pi;
+            PathItem pi = {};
             pi.ftCreation = creation;
             pi.ftLastWrite = lastWrite;
-            size_t len = 1 + wcslen( pwc );
-            pi.pwcPath = new WCHAR[ len ];
-            wcscpy_s( pi.pwcPath, len, pwc );
+            pi.pwcPath = path_dup( pwc );
 
             // defer loading capture times until absolutely needed because it's slow
 
-            ZeroMemory( &pi.ftCapture, sizeof pi.ftCapture );
+            lock_guard<mutex> lock( mtx );
+
+            elements.push_back( pi );
+        } //Add
+
+        void Add( const pathchar * pwc )
+        {
+            PathItem pi = {};
+            pi.pwcPath = path_dup( pwc );
 
             lock_guard<mutex> lock( mtx );
 
             elements.push_back( pi );
         } //Add
 
-        void Add( WCHAR * pwc )
+        void Add( const pathchar * pwc, uint32_t attribute )
         {
             PathItem pi = {};
-            size_t len = 1 + wcslen( pwc );
-            pi.pwcPath = new WCHAR[ len ];
-            wcscpy_s( pi.pwcPath, len, pwc );
+            pi.pwcPath = path_dup( pwc );
+            pi.ulAttribute = attribute;
 
             lock_guard<mutex> lock( mtx );
 
             elements.push_back( pi );
         } //Add
 
+#ifdef _WIN32
         void Add( char * pc )
         {
             PathItem pi = {};
@@ -296,6 +314,17 @@ class CPathArray
 
             elements.push_back( pi );
         } //Add
+#endif
+
+        // moves every item from source to the end of this array without copying the paths
+
+        void TakeAll( CPathArray & source )
+        {
+            lock_guard<mutex> lock( mtx );
+
+            elements.insert( elements.end(), source.elements.begin(), source.elements.end() );
+            source.elements.resize( 0 );
+        } //TakeAll
 
         bool Delete( size_t item )
         {
@@ -304,7 +333,7 @@ class CPathArray
             if ( item >= elements.size() )
                 return false;
 
-            delete elements[ item ].pwcPath;
+            delete [] elements[ item ].pwcPath;
             elements[ item ].pwcPath = NULL;
 
             elements.erase( elements.begin() + item );
@@ -0,0 +1,325 @@
+#pragma once
+
+//
+// A persistent index from a path to the file's size, last-write time, and a 64-bit value computed from its
+// contents, so unchanged files can skip being read again on later runs.
+// The file is a header, then fixed-size records sorted by path, then a heap of null-terminated paths.
+// It's memory mapped and binary searched in place, so opening an index with hundreds of millions of
+// entries costs nothing up front and only the pages that lookups touch are read.
+// Lookup() and Add() may be called from many threads. Save() writes every entry that was found or added
+// in this run, so files that have been deleted drop out of the index.
+//
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <djl_os.hxx>
+
+class CPathIndex
+{
+    private:
+        struct Header
+        {
+            char magic[ 8 ];
+            uint32_t version;
+            uint32_t charSize;     // sizeof( pathchar ), which differs between Windows and Linux
+            uint64_t tag;          // caller-defined; an index built with a different tag is ignored
+            uint64_t count;
+            uint64_t heapOffset;
+        };
+
+        struct Record
+        {
+            uint64_t size;
+            uint64_t lastWrite;
+            int64_t value;
+            uint64_t pathOffset;   // in pathchars from the start of the heap
+        };
+
+        struct Entry
+        {
+            const pathchar * path;
+            bool owned;            // false when path points into the mapped index
+            uint64_t size;
+            uint64_t lastWrite;
+            int64_t value;
+        };
+
+        static const uint32_t currentVersion = 1;
+
+        const uint8_t * view;
+        size_t cbView;
+        const Record * records;
+        const pathchar * heap;
+        size_t heapChars;
+        size_t count;
+#ifdef _WIN32
+        HANDLE hMap;
+#endif
+
+        std::mutex mtx;
+        std::vector<Entry> entries;
+        uint64_t tag;
+
+        static bool PathLess( const Entry & a, const Entry & b ) { return path_cmp( a.path, b.path ) < 0; }
+
+        void Unmap()
+        {
+            if ( 0 == view )
+                return;
+
+#ifdef _WIN32
+            UnmapViewOfFile( view );
+            CloseHandle( hMap );
+            hMap = 0;
+#else
+            munmap( (void *) view, cbView );
+#endif
+            view = 0;
+            cbView = 0;
+            records = 0;
+            heap = 0;
+            heapChars = 0;
+            count = 0;
+        } //Unmap
+
+        // Rejects files that were truncated or written by another version or platform. Only the header is
+        // checked so loading doesn't touch every record; Lookup() checks each record it reads.
+
+        bool Validate()
+        {
+            if ( cbView < sizeof( Header ) )
+                return false;
+
+            const Header * h = (const Header *) view;
+            if ( 0 != memcmp( h->magic, "DJLPIDX", 8 ) || currentVersion != h->version || sizeof( pathchar ) != h->charSize || tag != h->tag )
+                return false;
+
+            if ( h->heapOffset < sizeof( Header ) || h->heapOffset > cbView || ( h->heapOffset % sizeof( pathchar ) ) ||
+                 h->count > ( h->heapOffset - sizeof( Header ) ) / sizeof( Record ) )
+                return false;
+
+            // the heap must end with a null so no path can run off the end of the view
+
+            size_t chars = ( cbView - h->heapOffset ) / sizeof( pathchar );
+            const pathchar * p = (const pathchar *) ( view + h->heapOffset );
+            if ( 0 != h->count && ( 0 == chars || 0 != p[ chars - 1 ] ) )
+                return false;
+
+            records = (const Record *) ( view + sizeof( Header ) );
+            heap = p;
+            heapChars = chars;
+            count = (size_t) h->count;
+            return true;
+        } //Validate
+
+        static bool WriteAll( FILE * fp, const void * p, size_t cb ) { return ( 0 == cb ) || ( 1 == fwrite( p, cb, 1, fp ) ); }
+
+    public:
+        CPathIndex() : view( 0 ), cbView( 0 ), records( 0 ), heap( 0 ), heapChars( 0 ), count( 0 ), tag( 0 )
+        {
+#ifdef _WIN32
+            hMap = 0;
+#endif
+        }
+
+        ~CPathIndex()
+        {
+            Unmap();
+
+            for ( size_t i = 0; i < entries.size(); i++ )
+                if ( entries[ i ].owned )
+                    delete [] entries[ i ].path;
+        }
+
+        // Maps the index at file. Returns false if it doesn't exist or can't be used, in which case
+        // every lookup misses. Entries are kept for Save() either way. Tag should change whenever the
+        // meaning of the stored values changes.
+
+        bool Load( const pathchar * file, uint64_t indexTag )
+        {
+            Unmap();
+            tag = indexTag;
+
+#ifdef _WIN32
+            HANDLE hFile = CreateFileW( file, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, 0 );
+            if ( INVALID_HANDLE_VALUE == hFile )
+                return false;
+
+            LARGE_INTEGER size;
+            if ( GetFileSizeEx( hFile, &size ) && 0 != size.QuadPart )
+            {
+                hMap = CreateFileMapping( hFile, 0, PAGE_READONLY, 0, 0, 0 );
+                if ( 0 != hMap )
+                {
+                    view = (const uint8_t *) MapViewOfFile( hMap, FILE_MAP_READ, 0, 0, 0 );
+                    if ( 0 == view )
+                    {
+                        CloseHandle( hMap );
+                        hMap = 0;
+                    }
+                    else
+                        cbView = (size_t) size.QuadPart;
+                }
+            }
+
+            CloseHandle( hFile );
+#else
+            int fd = open( file, O_RDONLY | O_CLOEXEC );
+            if ( -1 == fd )
+                return false;
+
+            struct stat st;
+            if ( 0 == fstat( fd, &st ) && 0 != st.st_size )
+            {
+                void * p = mmap( 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+                if ( MAP_FAILED != p )
+                {
+                    view = (const uint8_t *) p;
+                    cbView = st.st_size;
+                    madvise( p, cbView, MADV_RANDOM );
+                }
+            }
+
+            close( fd );
+#endif
+
+            if ( 0 == view )
+                return false;
+
+            if ( !Validate() )
+            {
+                Unmap();
+                return false;
+            }
+
+            return true;
+        } //Load
+
+        size_t LoadedCount() { return count; }
+
+        // Returns true and the stored value if path is in the index with the same size and last-write time.
+        // A hit is kept for Save() without copying the path.
+
+        bool Lookup( const pathchar * path, uint64_t size, uint64_t lastWrite, int64_t & value )
+        {
+            size_t lo = 0;
+            size_t hi = count;
+
+            while ( lo < hi )
+            {
+                size_t mid = lo + ( hi - lo ) / 2;
+
+                // a corrupt offset would point outside the view. Miss rather than trust the rest of the index.
+
+                if ( records[ mid ].pathOffset >= heapChars )
+                    return false;
+
+                const pathchar * p = heap + records[ mid ].pathOffset;
+                int cmp = path_cmp( path, p );
+
+                if ( 0 == cmp )
+                {
+                    const Record & r = records[ mid ];
+                    if ( size != r.size || lastWrite != r.lastWrite )
+                        return false;
+
+                    value = r.value;
+                    Entry e = { p, false, r.size, r.lastWrite, r.value };
+                    std::lock_guard<std::mutex> lock( mtx );
+                    entries.push_back( e );
+                    return true;
+                }
+
+                if ( cmp < 0 )
+                    hi = mid;
+                else
+                    lo = mid + 1;
+            }
+
+            return false;
+        } //Lookup
+
+        void Add( const pathchar * path, uint64_t size, uint64_t lastWrite, int64_t value )
+        {
+            Entry e = { path_dup( path ), true, size, lastWrite, value };
+            std::lock_guard<std::mutex> lock( mtx );
+            entries.push_back( e );
+        } //Add
+
+        // Writes every entry found or added to file. A temporary file is renamed over the old index so
+        // a crash part way through leaves the previous index intact. Call after all threads are done.
+
+        bool Save( const pathchar * file )
+        {
+            std::sort( entries.begin(), entries.end(), PathLess );
+
+            size_t fileLen = path_len( file );
+            std::vector<pathchar> temp( file, file + fileLen );
+            const pathchar * suffix = PATH_TEXT( ".tmp" );
+            temp.insert( temp.end(), suffix, suffix + path_len( suffix ) + 1 );
+
+#ifdef _WIN32
+            FILE * fp = _wfopen( temp.data(), L"wb" );
+#else
+            FILE * fp = fopen( temp.data(), "wb" );
+#endif
+            if ( 0 == fp )
+                return false;
+
+            Header h;
+            memcpy( h.magic, "DJLPIDX", 8 );
+            h.version = currentVersion;
+            h.charSize = sizeof( pathchar );
+            h.tag = tag;
+            h.count = entries.size();
+            h.heapOffset = sizeof( Header ) + entries.size() * sizeof( Record );
+
+            bool ok = WriteAll( fp, &h, sizeof h );
+            uint64_t offset = 0;
+
+            for ( size_t i = 0; ok && i < entries.size(); i++ )
+            {
+                Record r = { entries[ i ].size, entries[ i ].lastWrite, entries[ i ].value, offset };
+                ok = WriteAll( fp, &r, sizeof r );
+                offset += path_len( entries[ i ].path ) + 1;
+            }
+
+            for ( size_t i = 0; ok && i < entries.size(); i++ )
+                ok = WriteAll( fp, entries[ i ].path, ( path_len( entries[ i ].path ) + 1 ) * sizeof( pathchar ) );
+
+            ok = ( 0 == fclose( fp ) ) && ok;
+
+            // hits point into the old index, so it stays mapped until the new one is written
+
+            for ( size_t i = 0; i < entries.size(); i++ )
+                if ( entries[ i ].owned )
+                    delete [] entries[ i ].path;
+            entries.clear();
+            Unmap();
+
+#ifdef _WIN32
+            ok = ok && MoveFileExW( temp.data(), file, MOVEFILE_REPLACE_EXISTING );
+            if ( !ok )
+                DeleteFileW( temp.data() );
+#else
+            ok = ok && ( 0 == rename( temp.data(), file ) );
+            if ( !ok )
+                unlink( temp.data() );
+#endif
+            return ok;
+        } //Save
+}; //CPathIndex
+
@@ -0,0 +1,183 @@
+#pragma once
+
+//
+// Compact storage for a large set of file paths. Each folder and file is a node holding a pointer to its
+// parent folder and just its own name, so the shared prefix of a path is stored once per folder rather than
+// once per file. Nodes are bump-allocated from large blocks, so adding one is a pointer increment and
+// there are no per-path heap allocations. Full paths are built on demand.
+// One thread may add to a store at a time. TakeAll() moves another store's nodes without copying them.
+//
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <mutex>
+
+#include <djl_os.hxx>
+
+class CPathStore
+{
+    public:
+        struct Node
+        {
+            const Node * parent;   // 0 for the root
+            uint32_t length;       // of name. Folder names end with a separator; names aren't null-terminated
+            pathchar name[ 1 ];
+        };
+
+    private:
+        static const size_t blockSize = 256 * 1024;
+
+        std::vector<uint8_t *> blocks;
+        uint8_t * next;
+        size_t left;
+        std::vector<const Node *> files;
+        std::mutex mtx;                   // guards TakeAll() calls from many threads
+
+        void * Alloc( size_t cb )
+        {
+            cb = round_up( cb, sizeof( void * ) );
+
+            // names longer than a block get a block to themselves so the current block isn't wasted
+
+            if ( cb > blockSize / 4 )
+            {
+                uint8_t * p = new uint8_t[ cb ];
+                blocks.push_back( p );
+                return p;
+            }
+
+            if ( cb > left )
+            {
+                next = new uint8_t[ blockSize ];
+                left = blockSize;
+                blocks.push_back( next );
+            }
+
+            void * p = next;
+            next += cb;
+            left -= cb;
+            return p;
+        } //Alloc
+
+        static bool NeedsSeparator( const pathchar * name, size_t len, bool folder )
+        {
+            return folder && ( 0 == len || PATH_SEP != name[ len - 1 ] );
+        } //NeedsSeparator
+
+        static size_t NodeSize( const pathchar * name, size_t len, bool folder )
+        {
+            return offsetof( Node, name ) + ( len + ( NeedsSeparator( name, len, folder ) ? 1 : 0 ) ) * sizeof( pathchar );
+        } //NodeSize
+
+        static const Node * InitNode( void * p, const Node * parent, const pathchar * name, size_t len, bool folder )
+        {
+            bool addSeparator = NeedsSeparator( name, len, folder );
+            Node * node = (Node *) p;
+            node->parent = parent;
+            node->length = (uint32_t) ( len + ( addSeparator ? 1 : 0 ) );
+            memcpy( node->name, name, len * sizeof( pathchar ) );
+            if ( addSeparator )
+                node->name[ len ] = PATH_SEP;
+            return node;
+        } //InitNode
+
+        const Node * AddNode( const Node * parent, const pathchar * name, size_t len, bool folder )
+        {
+            return InitNode( Alloc( NodeSize( name, len, folder ) ), parent, name, len, folder );
+        } //AddNode
+
+    public:
+        CPathStore() : next( 0 ), left( 0 ) {}
+        ~CPathStore() { Clear(); }
+
+        void Clear()
+        {
+            for ( size_t i = 0; i < blocks.size(); i++ )
+                delete [] blocks[ i ];
+
+            blocks.clear();
+            files.clear();
+            next = 0;
+            left = 0;
+        } //Clear
+
+        // name is a folder's own name, or the full path for a root. A separator is appended if it's missing.
+
+        const Node * AddFolder( const Node * parent, const pathchar * name, size_t len )
+        {
+            return AddNode( parent, name, len, true );
+        } //AddFolder
+
+        void AddFile( const Node * folder, const pathchar * name, size_t len )
+        {
+            files.push_back( AddNode( folder, name, len, false ) );
+        } //AddFile
+
+        // A folder node holding the full path, allocated on its own so it can be freed with FreeFolder()
+        // as soon as it's used. For callers that don't keep paths and so shouldn't keep folders either.
+
+        static const Node * NewFolder( const pathchar * path, size_t len )
+        {
+            return InitNode( new uint8_t[ NodeSize( path, len, true ) ], 0, path, len, true );
+        } //NewFolder
+
+        static void FreeFolder( const Node * node ) { delete [] (uint8_t *) node; }
+
+        size_t Count() { return files.size(); }
+        const Node * GetNode( size_t i ) { return files[ i ]; }
+
+        static size_t PathLength( const Node * node )
+        {
+            size_t len = 0;
+            for ( ; 0 != node; node = node->parent )
+                len += node->length;
+            return len;
+        } //PathLength
+
+        // Writes the null-terminated full path of node to buf. Returns its length, or 0 if cch is too small.
+
+        static size_t GetPath( const Node * node, pathchar * buf, size_t cch )
+        {
+            size_t len = PathLength( node );
+            if ( len >= cch )
+                return 0;
+
+            buf[ len ] = 0;
+            size_t end = len;
+            for ( ; 0 != node; node = node->parent )
+            {
+                end -= node->length;
+                memcpy( buf + end, node->name, node->length * sizeof( pathchar ) );
+            }
+
+            return len;
+        } //GetPath
+
+        // returns file i's full path in a newly allocated string the caller deletes with delete []
+
+        pathchar * DupPath( size_t i )
+        {
+            size_t len = PathLength( files[ i ] );
+            pathchar * p = new pathchar[ len + 1 ];
+            GetPath( files[ i ], p, len + 1 );
+            return p;
+        } //DupPath
+
+        // moves every file and the memory holding the nodes from source without copying them
+
+        void TakeAll( CPathStore & source )
+        {
+            std::lock_guard<std::mutex> lock( mtx );
+
+            blocks.insert( blocks.end(), source.blocks.begin(), source.blocks.end() );
+            files.insert( files.end(), source.files.begin(), source.files.end() );
+
+            source.blocks.clear();
+            source.files.clear();
+            source.next = 0;
+            source.left = 0;
+        } //TakeAll
+}; //CPathStore
+
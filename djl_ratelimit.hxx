@@ -0,0 +1,54 @@
+#pragma once
+
+//
+// A bytes-per-second budget shared by any number of threads. Each Acquire() reserves the next slice of a
+// virtual timeline with one CAS and sleeps until its slice starts, so threads are served in the order they
+// asked and the total never exceeds the rate, no matter how many threads there are. Unused time isn't
+// banked; a device that was idle doesn't get a burst afterwards.
+//
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+class CRateLimiter
+{
+    private:
+        std::atomic<int64_t> nextStart;    // ns on the steady clock when the next reservation may begin
+        uint64_t bytesPerSecond;           // 0 means unlimited
+
+        static int64_t Now()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+        } //Now
+
+    public:
+        CRateLimiter() : nextStart( 0 ), bytesPerSecond( 0 ) {}
+
+        // call before any threads use the limiter
+
+        void SetRate( uint64_t rate ) { bytesPerSecond = rate; }
+
+        // blocks until cb bytes fit in the budget
+
+        void Acquire( uint64_t cb )
+        {
+            if ( 0 == bytesPerSecond )
+                return;
+
+            int64_t cost = (int64_t) ( ( (double) cb * 1000000000.0 ) / (double) bytesPerSecond );
+            int64_t now = Now();
+            int64_t start = nextStart.load( std::memory_order_relaxed );
+            int64_t begin;
+
+            do
+            {
+                begin = ( start > now ) ? start : now;
+            } while ( !nextStart.compare_exchange_weak( start, begin + cost, std::memory_order_relaxed ) );
+
+            if ( begin > now )
+                std::this_thread::sleep_for( std::chrono::nanoseconds( begin - now ) );
+        } //Acquire
+}; //CRateLimiter
+
@@ -0,0 +1,253 @@
+#pragma once
+
+//
+// Minimal io_uring wrapper built on the raw system calls, so there is no dependency on liburing.
+// It only has what's needed to keep many small file operations in flight from one thread.
+// Not thread-safe; use one ring per thread.
+//
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+
+#include <djl_os.hxx>
+
+class CIoUring
+{
+    private:
+        int ringFd;
+        void * sqRing;
+        size_t sqRingSize;
+        void * cqRing;
+        size_t cqRingSize;
+        io_uring_sqe * sqes;
+        size_t sqesSize;
+
+        unsigned * sqHead;
+        unsigned * sqTail;
+        unsigned * sqMask;
+        unsigned * sqArray;
+        unsigned sqEntries;
+        unsigned sqLocalTail;  // sqes handed out but not yet published to the kernel
+
+        unsigned * cqHead;
+        unsigned * cqTail;
+        unsigned * cqMask;
+        io_uring_cqe * cqes;
+
+        static int Setup( unsigned entries, io_uring_params * p ) { return (int) syscall( __NR_io_uring_setup, entries, p ); }
+
+        static int Enter( int fd, unsigned toSubmit, unsigned minComplete, unsigned flags )
+        {
+            return (int) syscall( __NR_io_uring_enter, fd, toSubmit, minComplete, flags, 0, 0 );
+        } //Enter
+
+        static int Register( int fd, unsigned opcode, void * arg, unsigned count )
+        {
+            return (int) syscall( __NR_io_uring_register, fd, opcode, arg, count );
+        } //Register
+
+        void Shutdown()
+        {
+            if ( 0 != sqes )
+                munmap( sqes, sqesSize );
+            if ( 0 != cqRing && cqRing != sqRing )
+                munmap( cqRing, cqRingSize );
+            if ( 0 != sqRing )
+                munmap( sqRing, sqRingSize );
+            if ( -1 != ringFd )
+                close( ringFd );
+
+            sqes = 0;
+            cqRing = 0;
+            sqRing = 0;
+            ringFd = -1;
+        } //Shutdown
+
+    public:
+        CIoUring() : ringFd( -1 ), sqRing( 0 ), sqRingSize( 0 ), cqRing( 0 ), cqRingSize( 0 ), sqes( 0 ), sqesSize( 0 ),
+                     sqHead( 0 ), sqTail( 0 ), sqMask( 0 ), sqArray( 0 ), sqEntries( 0 ), sqLocalTail( 0 ),
+                     cqHead( 0 ), cqTail( 0 ), cqMask( 0 ), cqes( 0 ) {}
+
+        ~CIoUring() { Shutdown(); }
+
+        // entries: submission queue size. The kernel rounds it up to a power of 2 and makes the completion queue twice as big.
+        // returns false if io_uring isn't available, e.g. old kernels, seccomp filters, or io_uring_disabled.
+
+        bool Init( unsigned entries )
+        {
+            io_uring_params p;
+            memset( &p, 0, sizeof p );
+
+            ringFd = Setup( entries, &p );
+            if ( ringFd < 0 )
+            {
+                ringFd = -1;
+                return false;
+            }
+
+            sqRingSize = p.sq_off.array + p.sq_entries * sizeof( unsigned );
+            cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof( io_uring_cqe );
+            bool singleMap = ( 0 != ( p.features & IORING_FEAT_SINGLE_MMAP ) );
+            if ( singleMap )
+                sqRingSize = cqRingSize = get_max( sqRingSize, cqRingSize );
+
+            sqRing = mmap( 0, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING );
+            if ( MAP_FAILED == sqRing )
+            {
+                sqRing = 0;
+                Shutdown();
+                return false;
+            }
+
+            if ( singleMap )
+                cqRing = sqRing;
+            else
+            {
+                cqRing = mmap( 0, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING );
+                if ( MAP_FAILED == cqRing )
+                {
+                    cqRing = 0;
+                    Shutdown();
+                    return false;
+                }
+            }
+
+            sqesSize = p.sq_entries * sizeof( io_uring_sqe );
+            sqes = (io_uring_sqe *) mmap( 0, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES );
+            if ( MAP_FAILED == (void *) sqes )
+            {
+                sqes = 0;
+                Shutdown();
+                return false;
+            }
+
+            char * sq = (char *) sqRing;
+            sqHead = (unsigned *) ( sq + p.sq_off.head );
+            sqTail = (unsigned *) ( sq + p.sq_off.tail );
+            sqMask = (unsigned *) ( sq + p.sq_off.ring_mask );
+            sqArray = (unsigned *) ( sq + p.sq_off.array );
+            sqEntries = p.sq_entries;
+            sqLocalTail = *sqTail;
+
+            char * cq = (char *) cqRing;
+            cqHead = (unsigned *) ( cq + p.cq_off.head );
+            cqTail = (unsigned *) ( cq + p.cq_off.tail );
+            cqMask = (unsigned *) ( cq + p.cq_off.ring_mask );
+            cqes = (io_uring_cqe *) ( cq + p.cq_off.cqes );
+
+            return true;
+        } //Init
+
+        // returns true if the kernel implements every opcode in the list. Requires Linux 5.6 or later.
+
+        bool Supports( const uint8_t * ops, size_t count )
+        {
+            const unsigned maxOps = 256;
+            std::vector<uint8_t> buf( sizeof( io_uring_probe ) + maxOps * sizeof( io_uring_probe_op ), 0 );
+            io_uring_probe * probe = (io_uring_probe *) buf.data();
+
+            if ( Register( ringFd, IORING_REGISTER_PROBE, probe, maxOps ) < 0 )
+                return false;
+
+            for ( size_t i = 0; i < count; i++ )
+                if ( ops[ i ] > probe->last_op || 0 == ( probe->ops[ ops[ i ] ].flags & IO_URING_OP_SUPPORTED ) )
+                    return false;
+
+            return true;
+        } //Supports
+
+        // returns a zeroed sqe or 0 if the submission queue is full. Call Submit() to hand the sqes to the kernel.
+
+        io_uring_sqe * GetSqe()
+        {
+            unsigned head = __atomic_load_n( sqHead, __ATOMIC_ACQUIRE );
+            if ( ( sqLocalTail - head ) >= sqEntries )
+                return 0;
+
+            unsigned index = sqLocalTail & *sqMask;
+            sqArray[ index ] = index;
+            sqLocalTail++;
+
+            io_uring_sqe * sqe = & sqes[ index ];
+            memset( sqe, 0, sizeof( io_uring_sqe ) );
+            return sqe;
+        } //GetSqe
+
+        // publishes pending sqes and optionally waits for at least waitFor completions.
+        // returns the number of sqes consumed or -errno.
+
+        int Submit( unsigned waitFor )
+        {
+            __atomic_store_n( sqTail, sqLocalTail, __ATOMIC_RELEASE );
+            unsigned toSubmit = sqLocalTail - __atomic_load_n( sqHead, __ATOMIC_ACQUIRE );
+
+            do
+            {
+                int result = Enter( ringFd, toSubmit, waitFor, ( 0 != waitFor ) ? IORING_ENTER_GETEVENTS : 0 );
+                if ( result >= 0 )
+                    return result;
+            } while ( EINTR == errno );
+
+            return -errno;
+        } //Submit
+
+        // returns the oldest completion not yet marked seen or 0 if there are none
+
+        io_uring_cqe * PeekCqe()
+        {
+            unsigned head = *cqHead;
+            if ( head == __atomic_load_n( cqTail, __ATOMIC_ACQUIRE ) )
+                return 0;
+
+            return & cqes[ head & *cqMask ];
+        } //PeekCqe
+
+        void SeenCqe() { __atomic_store_n( cqHead, *cqHead + 1, __ATOMIC_RELEASE ); }
+
+        static void PrepOpenAt( io_uring_sqe * sqe, int dirFd, const char * path, int flags, mode_t mode, uint64_t userData )
+        {
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = dirFd;
+            sqe->addr = (uint64_t) path;
+            sqe->len = mode;
+            sqe->open_flags = flags;
+            sqe->user_data = userData;
+        } //PrepOpenAt
+
+        static void PrepStatx( io_uring_sqe * sqe, int dirFd, const char * path, int flags, unsigned mask, struct statx * pstx, uint64_t userData )
+        {
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = dirFd;
+            sqe->addr = (uint64_t) path;
+            sqe->len = mask;
+            sqe->off = (uint64_t) pstx;
+            sqe->statx_flags = flags;
+            sqe->user_data = userData;
+        } //PrepStatx
+
+        static void PrepRead( io_uring_sqe * sqe, int fd, void * buf, unsigned len, uint64_t offset, uint64_t userData )
+        {
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fd;
+            sqe->addr = (uint64_t) buf;
+            sqe->len = len;
+            sqe->off = offset;
+            sqe->user_data = userData;
+        } //PrepRead
+
+        static void PrepClose( io_uring_sqe * sqe, int fd, uint64_t userData )
+        {
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = fd;
+            sqe->user_data = userData;
+        } //PrepClose
+}; //CIoUring
+
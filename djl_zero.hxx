@@ -0,0 +1,175 @@
+#pragma once
+
+//
+// Checks whether a buffer is entirely zero as fast as memory bandwidth allows.
+// The widest kernel the CPU and OS support (AVX-512, AVX2, or SSE2) is picked at runtime from CPUID,
+// so one binary runs everywhere. Other architectures use a portable 64-bit word loop.
+// Each kernel ORs four vectors per iteration and tests once, so the loop is bound by loads, not branches.
+//
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ ) || defined( _M_X64 ) || defined( _M_IX86 )
+    #define DJL_ZERO_X86
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define DJL_ZERO_TARGET( x )
+    #else
+        #define DJL_ZERO_TARGET( x ) __attribute__(( target( x ) ))
+    #endif
+#endif
+
+class CZeroKernel
+{
+    public:
+        enum Level { levelWord, levelSSE2, levelAVX2, levelAVX512 };
+
+    private:
+        typedef bool ( * ZeroFunction )( const uint8_t * p, size_t len );
+
+        static bool ZeroBytes( const uint8_t * p, size_t len )
+        {
+            for ( size_t i = 0; i < len; i++ )
+                if ( 0 != p[ i ] )
+                    return false;
+            return true;
+        } //ZeroBytes
+
+        static bool ZeroWords( const uint8_t * p, size_t len )
+        {
+            // get to 8-byte alignment so the word loads are aligned
+
+            size_t head = ( 8 - ( (uintptr_t) p & 7 ) ) & 7;
+            if ( head >= len )
+                return ZeroBytes( p, len );
+
+            if ( !ZeroBytes( p, head ) )
+                return false;
+
+            p += head;
+            len -= head;
+
+            const uint64_t * pw = (const uint64_t *) p;
+            size_t words = len / 8;
+            size_t w = 0;
+
+            for ( ; w + 4 <= words; w += 4 )
+                if ( 0 != ( pw[ w ] | pw[ w + 1 ] | pw[ w + 2 ] | pw[ w + 3 ] ) )
+                    return false;
+
+            for ( ; w < words; w++ )
+                if ( 0 != pw[ w ] )
+                    return false;
+
+            return ZeroBytes( p + words * 8, len & 7 );
+        } //ZeroWords
+
+#ifdef DJL_ZERO_X86
+
+        DJL_ZERO_TARGET( "sse2" ) static bool ZeroSSE2( const uint8_t * p, size_t len )
+        {
+            const __m128i zero = _mm_setzero_si128();
+            size_t i = 0;
+
+            for ( ; i + 64 <= len; i += 64 )
+            {
+                __m128i a = _mm_or_si128( _mm_loadu_si128( (const __m128i *) ( p + i ) ), _mm_loadu_si128( (const __m128i *) ( p + i + 16 ) ) );
+                __m128i b = _mm_or_si128( _mm_loadu_si128( (const __m128i *) ( p + i + 32 ) ), _mm_loadu_si128( (const __m128i *) ( p + i + 48 ) ) );
+                if ( 0xffff != _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_or_si128( a, b ), zero ) ) )
+                    return false;
+            }
+
+            return ZeroWords( p + i, len - i );
+        } //ZeroSSE2
+
+        DJL_ZERO_TARGET( "avx2" ) static bool ZeroAVX2( const uint8_t * p, size_t len )
+        {
+            size_t i = 0;
+
+            for ( ; i + 128 <= len; i += 128 )
+            {
+                __m256i a = _mm256_or_si256( _mm256_loadu_si256( (const __m256i *) ( p + i ) ), _mm256_loadu_si256( (const __m256i *) ( p + i + 32 ) ) );
+                __m256i b = _mm256_or_si256( _mm256_loadu_si256( (const __m256i *) ( p + i + 64 ) ), _mm256_loadu_si256( (const __m256i *) ( p + i + 96 ) ) );
+                __m256i c = _mm256_or_si256( a, b );
+                if ( !_mm256_testz_si256( c, c ) )
+                    return false;
+            }
+
+            return ZeroSSE2( p + i, len - i );
+        } //ZeroAVX2
+
+        DJL_ZERO_TARGET( "avx512f" ) static bool ZeroAVX512( const uint8_t * p, size_t len )
+        {
+            size_t i = 0;
+
+            for ( ; i + 256 <= len; i += 256 )
+            {
+                __m512i a = _mm512_or_si512( _mm512_loadu_si512( (const void *) ( p + i ) ), _mm512_loadu_si512( (const void *) ( p + i + 64 ) ) );
+                __m512i b = _mm512_or_si512( _mm512_loadu_si512( (const void *) ( p + i + 128 ) ), _mm512_loadu_si512( (const void *) ( p + i + 192 ) ) );
+                __m512i c = _mm512_or_si512( a, b );
+                if ( 0 != _mm512_test_epi64_mask( c, c ) )
+                    return false;
+            }
+
+            return ZeroAVX2( p + i, len - i );
+        } //ZeroAVX512
+
+#endif
+
+        static ZeroFunction FunctionFor( Level level )
+        {
+#ifdef DJL_ZERO_X86
+            if ( levelAVX512 == level )
+                return ZeroAVX512;
+            if ( levelAVX2 == level )
+                return ZeroAVX2;
+            if ( levelSSE2 == level )
+                return ZeroSSE2;
+#endif
+            return ZeroWords;
+        } //FunctionFor
+
+        static ZeroFunction Current()
+        {
+            static ZeroFunction pfn = FunctionFor( Best() );
+            return pfn;
+        } //Current
+
+    public:
+        // the widest kernel both the CPU and the OS (which must save the wider registers) support
+
+        static Level Best()
+        {
+#ifdef DJL_ZERO_X86
+    #ifdef _MSC_VER
+            int regs[ 4 ];
+            __cpuid( regs, 1 );
+            bool sse2 = ( 0 != ( regs[ 3 ] & ( 1 << 26 ) ) );
+            bool osxsave = ( 0 != ( regs[ 2 ] & ( 1 << 27 ) ) );
+            uint64_t xcr0 = osxsave ? _xgetbv( 0 ) : 0;
+            __cpuidex( regs, 7, 0 );
+
+            if ( ( 0xe6 == ( xcr0 & 0xe6 ) ) && ( 0 != ( regs[ 1 ] & ( 1 << 16 ) ) ) )
+                return levelAVX512;
+            if ( ( 6 == ( xcr0 & 6 ) ) && ( 0 != ( regs[ 1 ] & ( 1 << 5 ) ) ) )
+                return levelAVX2;
+            if ( sse2 )
+                return levelSSE2;
+    #else
+            __builtin_cpu_init();
+            if ( __builtin_cpu_supports( "avx512f" ) )
+                return levelAVX512;
+            if ( __builtin_cpu_supports( "avx2" ) )
+                return levelAVX2;
+            if ( __builtin_cpu_supports( "sse2" ) )
+                return levelSSE2;
+    #endif
+#endif
+            return levelWord;
+        } //Best
+
+        static bool AllZero( const void * p, size_t len ) { return Current()( (const uint8_t *) p, len ); }
+}; //CZeroKernel
+
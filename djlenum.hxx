@@ -3,31 +3,78 @@
 //
 // Enumerate the filesystem to build a list of paths matching a criteria
 //
+// A fixed pool of workers walks the tree. Each worker owns a deque of folders waiting to be read; it
+// pushes and pops subfolders at the back, and idle workers steal from the front of other workers' deques,
+// which is where the biggest remaining subtrees are. Each worker collects results in its own arrays,
+// which are merged once when the walk completes so adds never contend.
+// When results go to a CPathStore, queued folders are nodes in the worker's store so a folder's path is
+// stored once no matter how many subfolders and files are under it. Otherwise each queued folder holds its
+// full path and is freed once it's read, so memory doesn't grow with the size of the tree.
+//
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <dirent.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#endif
+
+#include <functional>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <memory>
 
+#include <djltrace.hxx>
 #include <djlsav.hxx>
 #include <djl_pa.hxx>
-#include <djltrace.hxx>
-#include <ppl.h>
-
-using namespace concurrency;
+#include <djl_pathstore.hxx>
 
 class CEnumFolder
 {
     private:
+        struct Worker
+        {
+            std::mutex mtx;
+            std::deque<const CPathStore::Node *> dirs;   // folders to read
+            CPathStore store;              // results for resultStore and the folders they're in
+            CPathArray paths;              // results for resultPaths
+            CStringArray strings;          // results for resultStrings
+#ifndef _WIN32
+            std::vector<char> dirBuf;      // getdents64 output
+#endif
+        };
+
         bool recurse;
         CStringArray * resultStrings;
         CPathArray * resultPaths;
-        const WCHAR * const * extensions;
+        CPathStore * resultStore;
+        std::function<void ( const pathchar * )> resultCallback;
+        std::function<void ( long long )> folderTimer;
+        const pathchar * const * extensions;
         int extensionCount;
+        unsigned threadCount;
+
+        // state for the current Enumerate() call
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::atomic<size_t> pendingDirs;   // folders queued or being read. the walk is done when this is 0
+        const pathchar * fileSpec;
+        bool allFiles;
 
-        bool HasValidExtension( const WCHAR * pwc )
+        bool HasValidExtension( const pathchar * pwc )
         {
             if ( 0 == extensionCount )
                 return true;
 
-            const WCHAR * pext = wcsrchr( pwc, L'.' );
+            const pathchar * pext = path_rchr( pwc, '.' );
             if ( NULL == pext )
                 return false;
 
@@ -35,7 +82,7 @@ class CEnumFolder
 
             for ( int i = 0; i < extensionCount; i++ )
             {
-                int c = wcscmp( pext, extensions[ i ] );
+                int c = path_cmp( pext, extensions[ i ] );
 
                 if ( 0 == c )
                     return true;
@@ -47,62 +94,104 @@ class CEnumFolder
             return false;
         }
 
-    public:
-        // recurse:      true to recurse into folders
-        // pPathArray:   files found
-        // aExtensions:  a sorted list of valid file extensions not including a period. May be NULL.
-        // cExtensions:  count of extensions in the array. may be 0.
-
-        CEnumFolder( bool recurseFolders, CPathArray * pPathArray, const WCHAR * const * aExtensions, int cExtensions )
+        void Init( bool recurseFolders, const pathchar * const * aExtensions, int cExtensions )
         {
             recurse = recurseFolders;
             resultStrings = NULL;
-            resultPaths = pPathArray;
-            extensions = aExtensions;
-            extensionCount = cExtensions;
-        }
-
-        CEnumFolder( bool recurseFolders, CStringArray * pStringArray, const WCHAR * const * aExtensions, int cExtensions )
-        {
-            recurse = recurseFolders;
-            resultStrings = pStringArray;
             resultPaths = NULL;
+            resultStore = NULL;
             extensions = aExtensions;
             extensionCount = cExtensions;
-        }
+            threadCount = get_max( 1u, std::thread::hardware_concurrency() );
+            fileSpec = NULL;
+            allFiles = true;
+        } //Init
 
-        // pwcFolder:   the root of the enumeration, e.g. C:\users
-        // pwcFileSpec: a wildcard string like "*", "*.jpg", or "??.jpg". Can be NULL for "*"
+        // path is the folder's full path of len characters, the last nameLen of which are its name in parent.
+        // Nodes are only added to w's store by the thread that owns w, so the store needs no lock.
 
-        void Enumerate( const WCHAR * pwcFolder, const WCHAR * pwcFileSpec )
+        void PushDir( Worker & w, const CPathStore::Node * parent, const pathchar * path, size_t len, size_t nameLen )
         {
-            size_t len = wcslen( pwcFolder );
-            if ( 0 == len )
-                return;
+            const CPathStore::Node * p;
+            if ( 0 != resultStore )
+                p = w.store.AddFolder( parent, path + len - nameLen, nameLen );
+            else
+                p = CPathStore::NewFolder( path, len );
 
-            WCHAR *pwcSpec = ( 0 == pwcFileSpec ) ? L"*" : pwcFileSpec;
-            size_t specLen = wcslen( pwcSpec );
+            pendingDirs++;
+            lock_guard<mutex> lock( w.mtx );
+            w.dirs.push_back( p );
+        } //PushDir
 
-            WCHAR awc[ MAX_PATH ];
+        // LIFO from our own deque keeps the walk depth-first and cache-friendly. Steal FIFO from others.
 
-            if ( ( len + 1 + specLen ) >= _countof( awc ) )
+        const CPathStore::Node * PopDir( unsigned self )
+        {
             {
-                tracer.Trace( "skipping very long enumerate path %ws\n", pwcFolder );
-                return;
+                Worker & w = * workers[ self ];
+                lock_guard<mutex> lock( w.mtx );
+                if ( !w.dirs.empty() )
+                {
+                    const CPathStore::Node * p = w.dirs.back();
+                    w.dirs.pop_back();
+                    return p;
+                }
             }
 
-            wcscpy_s( awc, len + 1, pwcFolder );
-            if ( L'\\' != awc[ len - 1 ] )
+            for ( size_t i = 1; i < workers.size(); i++ )
+            {
+                Worker & victim = * workers[ ( self + i ) % workers.size() ];
+                lock_guard<mutex> lock( victim.mtx );
+                if ( !victim.dirs.empty() )
+                {
+                    const CPathStore::Node * p = victim.dirs.front();
+                    victim.dirs.pop_front();
+                    return p;
+                }
+            }
+
+            return NULL;
+        } //PopDir
+
+        // pwc is the full path; name and len are just the file's name within folder
+
+        void AddFile( Worker & w, const CPathStore::Node * folder, const pathchar * pwc, const pathchar * name, size_t len, FILETIME * creation, FILETIME * lastWrite )
+        {
+            if ( 0 != resultStore )
+                w.store.AddFile( folder, name, len );
+
+            if ( 0 != resultPaths )
             {
-                awc[ len++ ] = L'\\';
-                awc[ len ] = 0;
+                if ( 0 != creation )
+                    w.paths.Add( pwc, *creation, *lastWrite );
+                else
+                    w.paths.Add( pwc );
             }
 
-            wcscpy_s( awc + len, specLen + 1, pwcSpec );
+            if ( 0 != resultStrings )
+                w.strings.Add( pwc );
+
+            if ( resultCallback )
+                resultCallback( pwc );
+        } //AddFile
+
+#ifdef _WIN32
+
+        void ReadFolder( Worker & w, const CPathStore::Node * folder )
+        {
+            size_t specLen = wcslen( fileSpec );
+
+            WCHAR awc[ MAX_PATH ];
+            size_t len = CPathStore::GetPath( folder, awc, _countof( awc ) );
+
+            if ( 0 == len || ( len + 1 + specLen ) >= _countof( awc ) )
+            {
+                tracer.Trace( "skipping very long enumerate path in folder %.*ws\n", (int) folder->length, folder->name );
+                return;
+            }
 
-            bool allFiles = ( !wcscmp( pwcSpec, L"*" ) || !wcscmp( pwcSpec, L"*.*" ) );
+            wcscpy_s( awc + len, specLen + 1, fileSpec );
 
-            CStringArray aDirs;
             WIN32_FIND_DATA fd;
             HANDLE hFile = FindFirstFileEx( awc, FindExInfoBasic, &fd, FindExSearchNameMatch, 0, FIND_FIRST_EX_LARGE_FETCH | FIND_FIRST_EX_ON_DISK_ENTRIES_ONLY );
 
@@ -114,23 +203,18 @@ class CEnumFolder
                     {
                         _wcslwr( fd.cFileName );
                         size_t namelen = wcslen( fd.cFileName );
-        
-                        if ( ( namelen + len ) < _countof( awc ) )
+
+                        if ( ( namelen + len + 1 ) < _countof( awc ) )
                         {
                             wcscpy_s( awc + len, namelen + 1, fd.cFileName );
 
                             if ( fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
                             {
                                 if ( recurse && allFiles )
-                                    aDirs.Add( awc );
+                                    PushDir( w, folder, awc, len + namelen, namelen );
                             }
                             else if ( HasValidExtension( fd.cFileName ) )
-                            {
-                                if ( 0 != resultPaths )
-                                    resultPaths->Add( awc, fd.ftCreationTime, fd.ftLastWriteTime );
-                                if ( 0 != resultStrings )
-                                    resultStrings->Add( awc );
-                            }
+                                AddFile( w, folder, awc, fd.cFileName, namelen, &fd.ftCreationTime, &fd.ftLastWriteTime );
                         }
                         else
                         {
@@ -138,51 +222,262 @@ class CEnumFolder
                         }
                     }
                 } while ( FindNextFile( hFile, &fd ) );
-        
+
                 FindClose( hFile );
             }
 
-            if ( recurse )
+            // If the filespec didn't include all files, look for folders here
+
+            if ( recurse && !allFiles )
             {
-                // If the filespec didn't include all files, look for folders here
+                wcscpy_s( awc + len, 2, L"*" );
+                hFile = FindFirstFileEx( awc, FindExInfoBasic, &fd, FindExSearchLimitToDirectories, 0, FIND_FIRST_EX_LARGE_FETCH );
 
-                if ( !allFiles )
+                if ( INVALID_HANDLE_VALUE != hFile )
                 {
-                    wcscpy_s( awc + len, 2, L"*" );
-                    hFile = FindFirstFileEx( awc, FindExInfoBasic, &fd, FindExSearchLimitToDirectories, 0, FIND_FIRST_EX_LARGE_FETCH );
-                
-                    if ( INVALID_HANDLE_VALUE != hFile )
+                    do
                     {
-                        do
+                        if ( ( 0 != ( fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) ) && // required because the flag above is just a hint
+                             ( 0 != wcscmp( fd.cFileName, L".") ) &&
+                             ( 0 != wcscmp( fd.cFileName, L"..") ) )
                         {
-                            if ( ( 0 != ( fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) ) && // required because the flag above is just a hint
-                                 ( 0 != wcscmp( fd.cFileName, L".") ) &&
-                                 ( 0 != wcscmp( fd.cFileName, L"..") ) )
+                            size_t fileLen = wcslen( fd.cFileName );
+
+                            if ( ( len + fileLen + 2 ) >= _countof( awc ) )
                             {
-                                size_t fileLen = wcslen( fd.cFileName );
-                
-                                if ( ( len + fileLen + 2 ) >= _countof( awc ) )
-                                {
-                                    tracer.Trace( "skipping very long path %ws and directory %ws\n", awc, fd.cFileName );
-                                    continue;
-                                }
-
-                                wcscpy_s( awc + len, fileLen + 1, fd.cFileName );
-                                wcscpy_s( awc + len + fileLen, 2, L"\\" );
-
-                                aDirs.Add( awc );
+                                tracer.Trace( "skipping very long path %ws and directory %ws\n", awc, fd.cFileName );
+                                continue;
                             }
-                        } while ( FindNextFile( hFile, &fd ) );
-                
-                        FindClose( hFile );
+
+                            wcscpy_s( awc + len, fileLen + 1, fd.cFileName );
+                            PushDir( w, folder, awc, len + fileLen, fileLen );
+                        }
+                    } while ( FindNextFile( hFile, &fd ) );
+
+                    FindClose( hFile );
+                }
+            }
+        } //ReadFolder
+
+#else
+
+        struct linux_dirent64
+        {
+            uint64_t d_ino;
+            int64_t d_off;
+            unsigned short d_reclen;
+            unsigned char d_type;
+            char d_name[ 1 ];
+        };
+
+        // getdents64 returns many entries per call. readdir() would too, but its buffer is small and fixed.
+
+        void ReadFolder( Worker & w, const CPathStore::Node * folder )
+        {
+            const size_t dirBufSize = 128 * 1024;
+
+            char ac[ PATH_MAX ];
+            size_t len = CPathStore::GetPath( folder, ac, _countof( ac ) );
+            if ( 0 == len )
+            {
+                tracer.Trace( "skipping very long path in folder %.*s\n", (int) folder->length, folder->name );
+                return;
+            }
+
+            int dirFd = open( ac, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+            if ( -1 == dirFd )
+            {
+                tracer.Trace( "can't open folder %s, error %d\n", ac, errno );
+                return;
+            }
+
+            if ( w.dirBuf.size() < dirBufSize )
+                w.dirBuf.resize( dirBufSize );
+
+            do
+            {
+                long cb = syscall( SYS_getdents64, dirFd, w.dirBuf.data(), w.dirBuf.size() );
+                if ( cb <= 0 )
+                {
+                    if ( cb < 0 )
+                        tracer.Trace( "can't read folder %.*s, error %d\n", (int) len, ac, errno );
+                    break;
+                }
+
+                for ( long offset = 0; offset < cb; )
+                {
+                    linux_dirent64 * pent = (linux_dirent64 *) ( w.dirBuf.data() + offset );
+                    offset += pent->d_reclen;
+
+                    const char * name = pent->d_name;
+                    if ( !strcmp( name, "." ) || !strcmp( name, ".." ) )
+                        continue;
+
+                    size_t namelen = strlen( name );
+                    if ( ( namelen + len + 1 ) >= _countof( ac ) )
+                    {
+                        tracer.Trace( "skipping very long path %.*s and file %s\n", (int) len, ac, name );
+                        continue;
+                    }
+
+                    memcpy( ac + len, name, namelen + 1 );
+
+                    // some file systems (older XFS, some NFS servers) don't fill in the type
+
+                    unsigned char type = pent->d_type;
+                    if ( DT_UNKNOWN == type )
+                    {
+                        struct stat st;
+                        if ( 0 != fstatat( dirFd, name, &st, AT_SYMLINK_NOFOLLOW ) )
+                            continue;
+                        type = S_ISDIR( st.st_mode ) ? DT_DIR : S_ISREG( st.st_mode ) ? DT_REG : DT_UNKNOWN;
+                    }
+
+                    if ( DT_DIR == type )
+                    {
+                        if ( recurse )
+                            PushDir( w, folder, ac, len + namelen, namelen );
+                    }
+                    else if ( DT_REG == type ) // links, devices, pipes, and sockets are skipped. Opening a pipe would block.
+                    {
+                        if ( ( allFiles || 0 == fnmatch( fileSpec, name, 0 ) ) && HasValidExtension( name ) )
+                            AddFile( w, folder, ac, name, namelen, 0, 0 );
                     }
                 }
+            } while ( true );
+
+            close( dirFd );
+        } //ReadFolder
 
-                parallel_for( 0, (int) aDirs.Count(), [&] ( int i )
+#endif
+
+        void WorkerLoop( unsigned self )
+        {
+            unsigned idle = 0;
+
+            do
+            {
+                const CPathStore::Node * pdir = PopDir( self );
+                if ( 0 != pdir )
                 {
-                    Enumerate( aDirs[ i ], pwcFileSpec );
-                } );
-            }
+                    if ( folderTimer )
+                    {
+                        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                        ReadFolder( * workers[ self ], pdir );
+                        folderTimer( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count() );
+                    }
+                    else
+                        ReadFolder( * workers[ self ], pdir );
+
+                    if ( 0 == resultStore )
+                        CPathStore::FreeFolder( pdir );
+
+                    // subfolders were pushed before this decrement, so 0 means the whole tree is done
+
+                    pendingDirs--;
+                    idle = 0;
+                }
+                else if ( 0 == pendingDirs )
+                    break;
+                else if ( idle++ < 64 )
+                    std::this_thread::yield();
+                else
+                    sleep_ms( 1 );
+            } while ( true );
+        } //WorkerLoop
+
+    public:
+        typedef std::function<void ( const pathchar * )> FileCallback;
+
+        // recurse:      true to recurse into folders
+        // pPathArray:   files found
+        // aExtensions:  a sorted list of valid file extensions not including a period. May be NULL.
+        // cExtensions:  count of extensions in the array. may be 0.
+
+        CEnumFolder( bool recurseFolders, CPathArray * pPathArray, const pathchar * const * aExtensions, int cExtensions )
+        {
+            Init( recurseFolders, aExtensions, cExtensions );
+            resultPaths = pPathArray;
+        }
+
+        CEnumFolder( bool recurseFolders, CStringArray * pStringArray, const pathchar * const * aExtensions, int cExtensions )
+        {
+            Init( recurseFolders, aExtensions, cExtensions );
+            resultStrings = pStringArray;
         }
+
+        // pPathStore:   files found, stored compactly. Folder paths are shared, so this uses far less memory
+        //               than a CPathArray for large trees, but creation and last-write times aren't kept.
+
+        CEnumFolder( bool recurseFolders, CPathStore * pPathStore, const pathchar * const * aExtensions, int cExtensions )
+        {
+            Init( recurseFolders, aExtensions, cExtensions );
+            resultStore = pPathStore;
+        }
+
+        // onFile:       called for each file found as soon as it's found, possibly from many threads at once.
+        //               the path is only valid for the duration of the call.
+
+        CEnumFolder( bool recurseFolders, FileCallback onFile, const pathchar * const * aExtensions, int cExtensions )
+        {
+            Init( recurseFolders, aExtensions, cExtensions );
+            resultCallback = onFile;
+        }
+
+        // threads:     count of workers reading folders. Defaults to the number of cores. Network file
+        //              systems often do better with more because each folder read waits on a round trip.
+
+        void SetThreadCount( unsigned threads ) { threadCount = get_max( 1u, threads ); }
+
+        // onFolder:    called with the nanoseconds each folder took to read, from the thread that read it.
+
+        void SetFolderTimer( std::function<void ( long long )> onFolder ) { folderTimer = onFolder; }
+
+        // pwcFolder:   the root of the enumeration, e.g. C:\users or /home
+        // pwcFileSpec: a wildcard string like "*", "*.jpg", or "??.jpg". Can be NULL for "*"
+
+        void Enumerate( const pathchar * pwcFolder, const pathchar * pwcFileSpec )
+        {
+            size_t len = path_len( pwcFolder );
+            if ( 0 == len )
+                return;
+
+            fileSpec = ( 0 == pwcFileSpec ) ? PATH_TEXT( "*" ) : pwcFileSpec;
+            allFiles = ( !path_cmp( fileSpec, PATH_TEXT( "*" ) ) || !path_cmp( fileSpec, PATH_TEXT( "*.*" ) ) );
+
+            workers.resize( threadCount );
+            for ( size_t i = 0; i < workers.size(); i++ )
+                workers[ i ].reset( new Worker() );
+
+            pendingDirs = 0;
+            PushDir( * workers[ 0 ], 0, pwcFolder, len, len );
+
+            if ( 1 == threadCount )
+                WorkerLoop( 0 );
+            else
+            {
+                std::vector<std::thread> threads;
+                for ( unsigned t = 0; t < threadCount; t++ )
+                    threads.emplace_back( [this, t] () { WorkerLoop( t ); } );
+
+                for ( size_t t = 0; t < threads.size(); t++ )
+                    threads[ t ].join();
+            }
+
+            for ( size_t i = 0; i < workers.size(); i++ )
+            {
+                if ( 0 != resultPaths )
+                    resultPaths->TakeAll( workers[ i ]->paths );
+                if ( 0 != resultStrings )
+                    resultStrings->TakeAll( workers[ i ]->strings );
+
+                // folder nodes are moved too since the files refer to them
+
+                if ( 0 != resultStore )
+                    resultStore->TakeAll( workers[ i ]->store );
+            }
+
+            workers.clear();
+        } //Enumerate
 };
 
@@ -1,19 +1,21 @@
 #pragma once
 
 #include <random>
+#include <vector>
+#include <mutex>
 
 class CStringArray
 {
     private:
-        vector<WCHAR *> elements;
+        vector<pathchar *> elements;
         std::mutex mtx;
 
         static int PathCompare( const void * a, const void * b )
         {
-            WCHAR *pa = *(WCHAR **) a;
-            WCHAR *pb = *(WCHAR **) b;
+            pathchar *pa = *(pathchar **) a;
+            pathchar *pb = *(pathchar **) b;
 
-            return ( wcscmp( pa, pb ) );
+            return ( path_cmp( pa, pb ) );
         } //PathCompare
 
     public:
@@ -27,21 +29,21 @@ class CStringArray
         }
 
         size_t Count() { return elements.size(); }
-        WCHAR ** Array() { return elements.data(); }
-        WCHAR * Get( size_t i ) { return elements[ i ]; }
+        pathchar ** Array() { return elements.data(); }
+        pathchar * Get( size_t i ) { return elements[ i ]; }
 
         void Sort()
         {
-            qsort( elements.data(), elements.size(), sizeof( WCHAR *), PathCompare );
+            qsort( elements.data(), elements.size(), sizeof( pathchar * ), PathCompare );
         } //Sort
 
-        PWCHAR & operator[] ( size_t i ) { return elements[ i ]; }
+        pathchar * & operator[] ( size_t i ) { return elements[ i ]; }
 
         void Clear()
         {
             for ( size_t i = 0; i < elements.size(); i++ )
             {
-                delete elements[ i ];
+                delete [] elements[ i ];
                 elements[ i ] = NULL;
             }
 
@@ -66,16 +68,24 @@ class CStringArray
             }
         } //Randomize
 
-        void Add( WCHAR * pwc )
+        void Add( const pathchar * pwc )
         {
-            size_t len = 1 + wcslen( pwc );
-            WCHAR * p = new WCHAR[ len ];
-            wcscpy_s( p, len, pwc );
+            pathchar * p = path_dup( pwc );
 
             lock_guard<mutex> lock( mtx );
 
             elements.push_back( p );
         }
+
+        // moves every string from source to the end of this array without copying them
+
+        void TakeAll( CStringArray & source )
+        {
+            lock_guard<mutex> lock( mtx );
+
+            elements.insert( elements.end(), source.elements.begin(), source.elements.end() );
+            source.elements.resize( 0 );
+        } //TakeAll
 }; //CStringArray
 
 
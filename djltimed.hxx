@@ -1,8 +1,11 @@
 #pragma once
 
+#ifdef _WIN32
 #include <winbase.h>
-#include <chrono>
 #include <winnt.h>
+#endif
+
+#include <chrono>
 
 using namespace std;
 using namespace std::chrono;
@@ -35,8 +38,10 @@ class CTimed
 
 #if defined( _M_IX86 ) || defined( _M_X64 )
                 _InlineInterlockedAdd64( &sum, duration );
-#else
+#elif defined( _WIN32 )
                 _InterlockedAdd64( &sum, duration );
+#else
+                __atomic_fetch_add( &sum, duration, __ATOMIC_RELAXED );
 #endif
             }
 
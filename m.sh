@@ -0,0 +1 @@
+g++ -ggdb -O3 -fsigned-char -D NDEBUG -I . tailzero.cxx -o tailzero -lpthread
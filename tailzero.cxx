@@ -1,224 +1,2317 @@
-// It's by no means a sure thing that a file is corrupted if it ends with zeros.
-// WAV files are just like this by design along with other file formats.
-// But it's often true that when copying files, errors result in partial copies and zeroes at the end of files.
-
-#define _CRT_SECURE_NO_WARNINGS
-
-#include <windows.h>
-
-#include <vector>
-#include <chrono>
-#include <stdlib.h>
-#include <stdio.h>
-#include <process.h>
-#include <ppl.h>
-
-using namespace std;
-using namespace std::chrono;
-using namespace concurrency;
-
-#include <djl_os.hxx>
-#include <djlenum.hxx>
-
-CDJLTrace tracer;
-static std::mutex g_mtx;
-static bool muteErrors = false;
-const LONGLONG maxTailLen = 16384;
-LONGLONG tailLen = 8192;
-
-void usage()
-{
-    printf( "usage: tailzero [-m] [-s] <path>\n" );
-    printf( "  looks for files with zero tails indicating potential corruption.\n" );
-    printf( "  arguments:        -m    mute errors including access denied.\n" );
-    printf( "                    -s    single-threaded, not multi-threaded search.\n" );
-    printf( "                    -t:X  tail length 1..16384. default is 8192.\n" );
-    printf( "                    path  the path to search. default is current directory.\n" );
-    printf( "  e.g.:   tailzero\n" );
-    printf( "          tailzero c:\\foo\n" );
-    printf( "          tailzero -s c:\\foo\n" );
-    printf( "          tailzero \\\\server\\share\\folder\n" );
-    exit( 1 );
-} //usage
-
-class XHandle
-{
-    private:
-        HANDLE _h;
-    public:
-        XHandle( HANDLE h = INVALID_HANDLE_VALUE ) : _h( h ) {};
-        ~XHandle() { if ( ( INVALID_HANDLE_VALUE != _h ) && ( 0 != _h ) ) CloseHandle( _h ); }
-};
-
-const WCHAR * WinErrorString( DWORD dwerr = GetLastError() )
-{
-    static WCHAR awc[ MAX_PATH ];
-    awc[ 0 ] = 0; // in case FormatMessage fails
-    FormatMessage( FORMAT_MESSAGE_FROM_SYSTEM, 0, dwerr, 0, awc, _countof( awc ), 0 );
-    size_t len = wcslen( awc );
-    for ( size_t i = 0; i < len; i++ )
-        if ( L'\r' == awc[ i ] || L'\n' == awc[ i ] )
-            awc[ i ] = 0;
-    return awc;
-} //WinErrorString
-
-void search_folder( const WCHAR * pwc, size_t & found )
-{
-    assert( tailLen <= maxTailLen );
-    assert( tailLen >= 1 );
-    byte buf[ maxTailLen ];
-    HANDLE h = CreateFile( pwc, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING, 0, 0 );
-    if ( INVALID_HANDLE_VALUE != h )
-    {
-        XHandle xh( h );
-        LARGE_INTEGER fileSize;
-        if ( GetFileSizeEx( h, & fileSize ) )
-        {
-            if ( 0 != fileSize.QuadPart )
-            {
-                LONG toCheck = (LONG) get_min( fileSize.QuadPart, tailLen );
-                LARGE_INTEGER seek;
-                seek.QuadPart = -toCheck;
-                if ( SetFilePointerEx( h, seek, 0, FILE_END ) )
-                {
-                    if ( ReadFile( h, buf, toCheck, 0, 0 ) )
-                    {
-                        bool allZero = true;
-                        for ( LONG b = 0; b < toCheck; b++ )
-                        {
-                            if ( 0 != buf[ b ] )
-                            {
-                                allZero = false;
-                                break;
-                            }
-                        }
-    
-                        if ( allZero )
-                        {
-                            lock_guard<mutex> lock( g_mtx );
-                            found++;
-                            printf( "the last %4lu bytes are zero: %ws\n", toCheck, pwc );
-                        }
-                    }
-                    else if ( !muteErrors )
-                    {
-                        DWORD dwerr = GetLastError();
-                        lock_guard<mutex> lock( g_mtx );
-                        printf( "error %d %ws -- can't read %ld bytes from file %ws\n", dwerr, WinErrorString( dwerr ), toCheck, pwc );
-                    }
-                }
-                else if ( !muteErrors )
-                {
-                    DWORD dwerr = GetLastError();
-                    lock_guard<mutex> lock( g_mtx );
-                    printf( "can't seek to %ld bytes from end of file, error %d %ws\n", toCheck, dwerr, WinErrorString( dwerr ) );
-                }
-            }
-        }
-        else if ( !muteErrors )
-        {
-            DWORD dwerr = GetLastError();
-            lock_guard<mutex> lock( g_mtx );
-            printf( "can't get file length for file %ws, error %d %ws\n", pwc, dwerr, WinErrorString( dwerr ) );
-        }
-    }
-    else if ( !muteErrors )
-    {
-        DWORD dwerr = GetLastError();
-        lock_guard<mutex> lock( g_mtx );
-        printf( "can't open file %ws, error %d %ws\n", pwc, dwerr, WinErrorString( dwerr ) );
-    }
-} //search_folder
-
-int wmain( int argc, WCHAR * argv[] )
-{
-    WCHAR * path = (WCHAR *) L".";
-    bool parallel = true;
-
-    for ( int i = 1; i < argc; i++ )
-    {
-        if ( '-' == argv[i][0] || '/' == argv[i][0] )
-        {
-            WCHAR a = argv[i][1];
-
-            if ( 'm' == a )
-                muteErrors = true;
-            else if ( 's' == a )
-                parallel = false;
-            else if ( 't' == a )
-            {
-                if ( ':' != argv[i][2] )
-                {
-                    printf( "missing colon in tail length argument\n" );
-                    usage();
-                }
-
-                tailLen = wcstoull( argv[i] + 3, 0, 10 );
-                if ( tailLen < 1 || tailLen > maxTailLen )
-                {
-                    printf( "invalid tail length specified: %lld\n", tailLen );
-                    usage();
-                }
-            }
-            else
-            {
-                printf( "invalid argument\n" );
-                usage();
-            }
-        }
-        else
-            path = argv[i];
-    }
-
-    WCHAR fullPath[ MAX_PATH ];
-    DWORD result = GetFullPathName( path, _countof( fullPath ), fullPath, 0 );
-    if ( 0 == result )
-    {
-        DWORD dwerr = GetLastError();
-        printf( "error %d %ws -- unable to get full path for %ws\n", dwerr, WinErrorString( dwerr ), path );
-        usage();
-    }
-
-    result = GetFileAttributes( fullPath );
-    if ( INVALID_FILE_ATTRIBUTES == result )
-    {
-        DWORD dwerr = GetLastError();
-        printf( "error %d %ws -- can't find path %ws\n", dwerr, WinErrorString( dwerr ), fullPath );
-        usage();
-    }
-
-    if ( ! ( result & FILE_ATTRIBUTE_DIRECTORY ) )
-    {
-        printf( "error -- path isn't a directory: %ws\n", fullPath );
-        usage();
-    }
-
-    CPathArray paths;
-    CEnumFolder enumerate( true, &paths, 0, 0 );
-    enumerate.Enumerate( fullPath, 0 );
-
-    if ( 0 == paths.Count() )
-    {
-        printf( "no files found\n" );
-        usage();
-    }
-
-    size_t found = 0;
-    size_t cPaths = paths.Count();
-    printf( "looking at %zu files in folder %ws\n", cPaths, fullPath );
-
-    if ( parallel )
-    {
-        parallel_for( (size_t) 0, cPaths, [&] (size_t i)
-        {
-            search_folder( paths.Get( i ), found );
-        } );
-    }
-    else
-    {
-        for ( size_t i = 0; i < cPaths; i++ )
-            search_folder( paths.Get( i ), found );
-    }
-
-    printf( "found %zu files with a zero tail out of %zu\n", found, cPaths );
-} //wmain
+// It's by no means a sure thing that a file is corrupted if it ends with zeros.
+// WAV files are just like this by design along with other file formats.
+// But it's often true that when copying files, errors result in partial copies and zeroes at the end of files.
+// A dropped chunk in a multi-chunk transfer can also leave zeros in the middle of a file; -d reads whole files
+// to find those, skipping formats like WAV where long runs of zeros are normal.
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <sys/sysmacros.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <assert.h>
+
+using namespace std;
+using namespace std::chrono;
+
+#include <djl_os.hxx>
+#include <djlenum.hxx>
+#include <djl_mpmc.hxx>
+#include <djl_zero.hxx>
+#include <djl_bufpool.hxx>
+#include <djl_pathindex.hxx>
+#include <djl_ratelimit.hxx>
+#include <djl_batch.hxx>
+#include <djl_pa.hxx>
+#include <djl_histogram.hxx>
+
+#ifndef _WIN32
+#include <djl_uring.hxx>
+#endif
+
+CDJLTrace tracer;
+static bool muteErrors = false;
+static bool checkExtents = true;        // look at allocation metadata before reading
+static atomic<size_t> found( 0 );
+static atomic<size_t> foundInMetadata( 0 ); // subset of found where no data was read
+static const pathchar * indexFile = 0;  // -i results index, or 0 if every file is read
+static CPathIndex g_index;
+static atomic<size_t> indexHits( 0 );   // unchanged files whose verdict came from the index
+static atomic<size_t> indexReads( 0 );  // new or changed files that were read and added to the index
+const long long maxTailLen = 4 * 1024 * 1024;
+long long tailLen = 8192;
+static CBufferPool g_buffers;           // tailLen rounded up to whole pages
+static unsigned checkThreads = 0;       // 0 means pick a count based on the engine and cores
+static unsigned enumThreads = 0;        // 0 means one per core
+const unsigned maxThreads = 1024;
+const unsigned preadMaxThreads = 64;    // blocking reads need many threads to keep a network device busy
+const size_t streamQueueSize = 65536;   // paths waiting to be checked in streaming mode; bounds memory use
+const long long progressMS = 1000;      // how often streaming mode reports the running count of files found
+static long long deepRunLen = 0;        // -d minimum zero run to report. 0 means only tails are checked
+const long long deepDefaultRunLen = 64 * 1024;
+const long long deepMaxRunLen = 1024 * 1024 * 1024;
+const size_t deepBlock = 4096;          // zero runs are found in file-aligned blocks of this size
+const size_t deepChunk = 1024 * 1024;   // each sequential read in a deep scan
+static CBufferPool g_deepBuffers;       // deepChunk bytes each
+static CRateLimiter g_budget;           // -b bytes per second shared by all deep scan reads
+static atomic<size_t> deepRuns( 0 );    // zero runs found by -d
+static atomic<size_t> deepFiles( 0 );   // files with at least one zero run
+static atomic<size_t> deepSkipped( 0 ); // files not deep scanned because zeros are expected in their format
+
+enum OutputFormat { outText, outJson, outCsv };
+static OutputFormat outputFormat = outText;
+static bool sortOutput = false;         // -r holds results until the end and writes them sorted by path
+static FILE * infoOut = stdout;         // progress and totals; stderr when results are json or csv
+static FILE * resultOut = stdout;       // results; the null device while benchmarking
+
+// -x times each operation into per-phase histograms. Timing is off otherwise, so it costs one branch.
+
+enum Phase { phaseEnumerate, phaseOpen, phaseRead, phaseZeroCheck, phaseOutput, phaseCount };
+static bool timingPhases = false;
+static CLatencyHistogram g_phaseTimes[ phaseCount ];
+static atomic<long long> bytesRead( 0 );   // only counted while timing
+
+#ifndef _WIN32
+static bool usePread = false;
+const unsigned uringDepth = 256;        // tail probes in flight per io_uring thread
+const unsigned uringMaxThreads = 4;     // a few rings keep thousands of probes in flight
+const size_t uringBufferBudget = 64 * 1024 * 1024; // per thread. large tail windows get fewer slots
+#endif
+
+void record_phase( Phase phase, steady_clock::time_point start )
+{
+    g_phaseTimes[ phase ].Record( duration_cast<nanoseconds>( steady_clock::now() - start ).count() );
+} //record_phase
+
+void count_read( long long cb )
+{
+    if ( timingPhases && cb > 0 )
+        bytesRead += cb;
+} //count_read
+
+class CPhaseTimer
+{
+    private:
+        Phase phase;
+        bool active;
+        steady_clock::time_point start;
+
+    public:
+        CPhaseTimer( Phase p ) : phase( p ), active( timingPhases )
+        {
+            if ( active )
+                start = steady_clock::now();
+        }
+
+        ~CPhaseTimer() { Complete(); }
+
+        void Complete()
+        {
+            if ( active )
+            {
+                active = false;
+                record_phase( phase, start );
+            }
+        } //Complete
+}; //CPhaseTimer
+
+void usage()
+{
+    printf( "usage: tailzero [-a] [-b:X] [-c:X] [-d[:X]] [-e:X] [-g:S] [-i:F] [-m] [-o:F] [-p] [-q] [-r] [-s] [-t:X] [-x[:L]] <path>\n" );
+    printf( "  looks for files with zero tails indicating potential corruption.\n" );
+    printf( "  arguments:        -a    always read tails; don't trust holes and unwritten extents.\n" );
+    printf( "                    -b:X  limit deep scan reads to X bytes per second across all threads.\n" );
+    printf( "                    -c:X  threads checking files. default depends on the engine and core count.\n" );
+    printf( "                    -d:X  deep scan: read whole files and report aligned zero runs of at least X bytes. default 64k.\n" );
+    printf( "                    -e:X  threads enumerating folders. default is the core count.\n" );
+    printf( "                    -g:S  generate a synthetic tree in path, a new or empty folder. e.g. -g:depth=3,fanout=4,files=10000,size=1k-1m,zero=0.01\n" );
+    printf( "                    -i:F  results index file. only new and changed files are read; others use the saved verdict.\n" );
+    printf( "                    -m    mute errors including access denied.\n" );
+    printf( "                    -o:F  output format: text, json (JSON Lines), or csv. default is text.\n" );
+#ifndef _WIN32
+    printf( "                    -p    use synchronous pread, not io_uring.\n" );
+#endif
+    printf( "                    -q    stream files to checkers through a queue as they're found.\n" );
+    printf( "                    -r    write results sorted by path after the scan so runs can be diffed.\n" );
+    printf( "                    -s    single-threaded, not multi-threaded search. -q is ignored.\n" );
+    printf( "                    -t:X  tail length 1..4m. k and m suffixes are allowed. default is 8192.\n" );
+    printf( "                    -x:L  benchmark each engine with each thread count in list L. default is 1,4,16.\n" );
+    printf( "                          add cold to the list to evict file data from the cache before each run.\n" );
+    printf( "                    path  the path to search. default is current directory.\n" );
+#ifdef _WIN32
+    printf( "  e.g.:   tailzero\n" );
+    printf( "          tailzero c:\\foo\n" );
+    printf( "          tailzero -s c:\\foo\n" );
+    printf( "          tailzero \\\\server\\share\\folder\n" );
+#else
+    printf( "  e.g.:   tailzero\n" );
+    printf( "          tailzero /home/foo\n" );
+    printf( "          tailzero -s /home/foo\n" );
+    printf( "          tailzero /mnt/nas/share/folder\n" );
+#endif
+    exit( 1 );
+} //usage
+
+#ifdef _WIN32
+
+class XHandle
+{
+    private:
+        HANDLE _h;
+    public:
+        XHandle( HANDLE h = INVALID_HANDLE_VALUE ) : _h( h ) {};
+        ~XHandle() { if ( ( INVALID_HANDLE_VALUE != _h ) && ( 0 != _h ) ) CloseHandle( _h ); }
+};
+
+const char * ErrorString( DWORD dwerr = GetLastError() )
+{
+    static char ac[ MAX_PATH ];
+    ac[ 0 ] = 0; // in case FormatMessage fails
+    FormatMessageA( FORMAT_MESSAGE_FROM_SYSTEM, 0, dwerr, 0, ac, _countof( ac ), 0 );
+    size_t len = strlen( ac );
+    for ( size_t i = 0; i < len; i++ )
+        if ( '\r' == ac[ i ] || '\n' == ac[ i ] )
+            ac[ i ] = 0;
+    return ac;
+} //ErrorString
+
+#else
+
+class XFd
+{
+    private:
+        int _fd;
+    public:
+        XFd( int fd = -1 ) : _fd( fd ) {};
+        ~XFd() { if ( -1 != _fd ) close( _fd ); }
+};
+
+const char * ErrorString( int err = errno ) { return strerror( err ); }
+
+#endif
+
+enum TailError { errOpen, errLength, errSeek, errRead };
+
+// tailHole: the tail is a hole or unwritten extent, so it was found without reading any data.
+// tailIndexed: the file hasn't changed since the run that saved the -i index.
+
+enum TailSource { tailRead, tailHole, tailIndexed };
+
+// Workers don't print. Results are batched per thread and formatted and written by one output thread.
+// Errors follow the zero results in the same order as TailError.
+
+enum ResultKind { resTail, resHole, resIndexed, resRun, resOpenError, resLengthError, resSeekError, resReadError };
+
+struct TailResult
+{
+    pathchar * path;      // owned by the result; freed by the output thread
+    ResultKind kind;
+    int error;
+    long long size;       // -1 if it isn't known
+    long long offset;     // where the zeros start
+    long long length;     // zero bytes, or for errors the bytes that were being read
+};
+
+static CBatchCollector<TailResult> g_results;
+static CPathArray g_sortedPaths;        // -r: each path's attribute is the index of its line
+static vector<string> g_sortedLines;
+
+void add_result( const pathchar * p, ResultKind kind, int error, long long size, long long offset, long long length )
+{
+    TailResult r = { path_dup( p ), kind, error, size, offset, length };
+    g_results.Add( r );
+} //add_result
+
+void report_error( TailError e, const pathchar * p, int err, long long toCheck, long long size = -1 )
+{
+    if ( muteErrors )
+        return;
+
+    add_result( p, (ResultKind) ( resOpenError + e ), err, size, 0, toCheck );
+} //report_error
+
+void report_zero_tail( const pathchar * p, long long size, long long toCheck, TailSource source = tailRead )
+{
+    found++;
+    if ( tailHole == source )
+        foundInMetadata++;
+
+    add_result( p, (ResultKind) ( resTail + source ), 0, size, size - toCheck, toCheck );
+} //report_zero_tail
+
+void append_format( string & s, const char * format, ... )
+{
+    char buf[ 1024 ];
+    va_list args;
+    va_start( args, format );
+    int len = vsnprintf( buf, sizeof buf, format, args );
+    va_end( args );
+
+    if ( len < 0 )
+        return;
+
+    if ( len < (int) sizeof buf )
+    {
+        s.append( buf, len );
+        return;
+    }
+
+    // long paths
+
+    size_t start = s.size();
+    s.resize( start + len + 1 );
+    va_start( args, format );
+    vsnprintf( &s[ start ], len + 1, format, args );
+    va_end( args );
+    s.resize( start + len );
+} //append_format
+
+// json and csv are UTF-8. Linux paths are bytes, so they're written as they are.
+
+void append_path_utf8( string & s, const pathchar * p )
+{
+#ifdef _WIN32
+    int len = WideCharToMultiByte( CP_UTF8, 0, p, -1, 0, 0, 0, 0 );
+    if ( len <= 1 )
+        return;
+
+    size_t start = s.size();
+    s.resize( start + len );
+    WideCharToMultiByte( CP_UTF8, 0, p, -1, &s[ start ], len, 0, 0 );
+    s.resize( start + len - 1 );
+#else
+    s.append( p );
+#endif
+} //append_path_utf8
+
+// Returns the length of the well-formed UTF-8 sequence at p, or 0 if it isn't one.
+// Overlong forms, surrogates, and code points past U+10FFFF are rejected.
+
+size_t utf8_sequence_len( const unsigned char * p, size_t left )
+{
+    unsigned char c = p[ 0 ];
+    if ( c < 0x80 )
+        return 1;
+
+    size_t len;
+    unsigned char lo = 0x80, hi = 0xbf;   // range of the second byte
+
+    if ( c >= 0xc2 && c <= 0xdf )
+        len = 2;
+    else if ( c >= 0xe0 && c <= 0xef )
+    {
+        len = 3;
+        if ( 0xe0 == c )
+            lo = 0xa0;
+        else if ( 0xed == c )
+            hi = 0x9f;
+    }
+    else if ( c >= 0xf0 && c <= 0xf4 )
+    {
+        len = 4;
+        if ( 0xf0 == c )
+            lo = 0x90;
+        else if ( 0xf4 == c )
+            hi = 0x8f;
+    }
+    else
+        return 0;
+
+    if ( left < len || p[ 1 ] < lo || p[ 1 ] > hi )
+        return 0;
+
+    for ( size_t i = 2; i < len; i++ )
+        if ( 0x80 != ( p[ i ] & 0xc0 ) )
+            return 0;
+
+    return len;
+} //utf8_sequence_len
+
+// Linux names are bytes and needn't be UTF-8. A byte that isn't part of valid UTF-8 is written as the
+// lone surrogate \udcXX, the convention Python's surrogateescape uses, so the output stays valid JSON and
+// os.fsencode() recovers the original name.
+
+void append_json_path( string & s, const pathchar * p )
+{
+    string utf8;
+    append_path_utf8( utf8, p );
+    const unsigned char * u = (const unsigned char *) utf8.data();
+
+    s += '"';
+    for ( size_t i = 0; i < utf8.size(); )
+    {
+        unsigned char c = u[ i ];
+        size_t len = utf8_sequence_len( u + i, utf8.size() - i );
+
+        if ( 0 == len )
+        {
+            append_format( s, "\\udc%02x", c );
+            len = 1;
+        }
+        else if ( '"' == c || '\\' == c )
+        {
+            s += '\\';
+            s += c;
+        }
+        else if ( c < 0x20 )
+            append_format( s, "\\u%04x", c );
+        else
+            s.append( utf8, i, len );
+
+        i += len;
+    }
+    s += '"';
+} //append_json_path
+
+void append_csv_path( string & s, const pathchar * p )
+{
+    string utf8;
+    append_path_utf8( utf8, p );
+
+    s += '"';
+    for ( size_t i = 0; i < utf8.size(); i++ )
+    {
+        if ( '"' == utf8[ i ] )
+            s += '"';
+        s += utf8[ i ];
+    }
+    s += '"';
+} //append_csv_path
+
+// ErrorString() uses a static buffer, so it's only called on the output thread
+
+void format_result( TailResult & r, string & line )
+{
+    static const char * kinds[] = { "tail", "hole", "indexed", "run", "open", "length", "seek", "read" };
+    static const char * notes[] = { "", " (hole)", " (indexed)" };
+    bool isError = ( r.kind >= resOpenError );
+    long long zeroLen = isError ? 0 : r.length;
+
+    if ( outJson == outputFormat )
+    {
+        line += "{\"path\":";
+        append_json_path( line, r.path );
+        append_format( line, ",\"size\":%lld,\"offset\":%lld,\"zero\":%lld,\"error\":%d,\"kind\":\"%s\"}\n",
+                       r.size, r.offset, zeroLen, r.error, kinds[ r.kind ] );
+    }
+    else if ( outCsv == outputFormat )
+    {
+        append_csv_path( line, r.path );
+        append_format( line, ",%lld,%lld,%lld,%d,%s\n", r.size, r.offset, zeroLen, r.error, kinds[ r.kind ] );
+    }
+    else if ( resRun == r.kind )
+        append_format( line, "%lld zero bytes at offset %lld: " PATH_FMT "\n", r.length, r.offset, r.path );
+    else if ( !isError )
+        append_format( line, "the last %4lld bytes are zero%s: " PATH_FMT "\n", r.length, notes[ r.kind ], r.path );
+    else if ( resOpenError == r.kind )
+        append_format( line, "can't open file " PATH_FMT ", error %d %s\n", r.path, r.error, ErrorString( r.error ) );
+    else if ( resLengthError == r.kind )
+        append_format( line, "can't get file length for file " PATH_FMT ", error %d %s\n", r.path, r.error, ErrorString( r.error ) );
+    else if ( resSeekError == r.kind )
+        append_format( line, "can't seek to %lld bytes from end of file, error %d %s\n", r.length, r.error, ErrorString( r.error ) );
+    else
+        append_format( line, "error %d %s -- can't read %lld bytes from file " PATH_FMT "\n", r.error, ErrorString( r.error ), r.length, r.path );
+} //format_result
+
+// runs on the output thread
+
+void write_result( TailResult & r )
+{
+    CPhaseTimer timeOutput( phaseOutput );
+    string line;
+    format_result( r, line );
+
+    if ( sortOutput )
+    {
+        g_sortedPaths.Add( r.path, (uint32_t) g_sortedLines.size() );
+        g_sortedLines.push_back( line );
+    }
+    else
+        fwrite( line.data(), line.size(), 1, resultOut );
+
+    delete [] r.path;
+} //write_result
+
+void start_output()
+{
+    if ( outCsv == outputFormat )
+        fprintf( resultOut, "path,size,offset,zero,error,kind\n" );
+
+    fflush( infoOut );
+    g_results.Start( write_result );
+} //start_output
+
+// call once every worker is done
+
+void finish_output()
+{
+    g_results.Stop();
+
+    if ( sortOutput )
+    {
+        g_sortedPaths.SortOnPath();
+        for ( size_t i = 0; i < g_sortedPaths.Count(); i++ )
+        {
+            string & line = g_sortedLines[ g_sortedPaths[ i ].ulAttribute ];
+            fwrite( line.data(), line.size(), 1, resultOut );
+        }
+
+        g_sortedPaths.Clear();
+        g_sortedLines.clear();
+    }
+
+    fflush( resultOut );
+} //finish_output
+
+// Returns true if the index has a verdict for the file at its current size and last-write time.
+// A zero tail is reported again, so the output of a run doesn't depend on whether it used an index.
+
+bool tail_from_index( const pathchar * p, long long size, uint64_t lastWrite )
+{
+    if ( 0 == indexFile )
+        return false;
+
+    int64_t zeroLen;
+    if ( !g_index.Lookup( p, size, lastWrite, zeroLen ) )
+        return false;
+
+    indexHits++;
+    if ( 0 != zeroLen )
+        report_zero_tail( p, size, zeroLen, tailIndexed );
+    return true;
+} //tail_from_index
+
+// Saves the verdict for a file that was read: the length of the zero tail, or 0. Errors aren't saved so they're retried.
+
+void tail_to_index( const pathchar * p, long long size, uint64_t lastWrite, long long zeroLen )
+{
+    if ( 0 == indexFile )
+        return;
+
+    indexReads++;
+    g_index.Add( p, size, lastWrite, zeroLen );
+} //tail_to_index
+
+bool tail_is_zero( const uint8_t * buf, size_t len )
+{
+    CPhaseTimer timeZeroCheck( phaseZeroCheck );
+    return CZeroKernel::AllZero( buf, len );
+} //tail_is_zero
+
+#ifdef _WIN32
+
+// Returns where the data in the tail window ends. Bytes past that are in sparse ranges that read as zeros.
+// Only sparse files can have such ranges, so others aren't queried; on a share each query is a round trip.
+
+long long tail_data_end( HANDLE h, long long fileSize, long long toCheck, DWORD attributes )
+{
+    if ( !checkExtents || 0 == ( attributes & FILE_ATTRIBUTE_SPARSE_FILE ) )
+        return fileSize;
+
+    FILE_ALLOCATED_RANGE_BUFFER query;
+    query.FileOffset.QuadPart = fileSize - toCheck;
+    query.Length.QuadPart = toCheck;
+
+    FILE_ALLOCATED_RANGE_BUFFER ranges[ 16 ];
+    DWORD cbRanges = 0;
+    if ( !DeviceIoControl( h, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof query, ranges, sizeof ranges, &cbRanges, 0 ) )
+        return fileSize; // ERROR_MORE_DATA means many ranges, so just read it all. Other errors: the FS doesn't know.
+
+    DWORD count = cbRanges / sizeof( FILE_ALLOCATED_RANGE_BUFFER );
+    if ( 0 == count )
+        return query.FileOffset.QuadPart;
+
+    FILE_ALLOCATED_RANGE_BUFFER & last = ranges[ count - 1 ];
+    return get_min( fileSize, last.FileOffset.QuadPart + last.Length.QuadPart );
+} //tail_data_end
+
+uint64_t file_time( const FILETIME & ft ) { return ( ( (uint64_t) ft.dwHighDateTime ) << 32 ) | ft.dwLowDateTime; }
+
+// returns false if the file couldn't be opened, so a deep scan doesn't report the same error
+
+bool search_folder( const pathchar * pwc )
+{
+    assert( tailLen <= maxTailLen );
+    assert( tailLen >= 1 );
+
+    if ( 0 != indexFile )
+    {
+        WIN32_FILE_ATTRIBUTE_DATA fad;
+        if ( GetFileAttributesEx( pwc, GetFileExInfoStandard, &fad ) &&
+             tail_from_index( pwc, ( ( (long long) fad.nFileSizeHigh ) << 32 ) | fad.nFileSizeLow, file_time( fad.ftLastWriteTime ) ) )
+            return true;
+    }
+
+    CPooledBuffer pooled( g_buffers );
+    uint8_t * buf = pooled.Get();
+    if ( 0 == buf )
+    {
+        report_error( errRead, pwc, ERROR_NOT_ENOUGH_MEMORY, tailLen );
+        return true;
+    }
+
+    // the open phase covers opening and the size and extent queries.
+    // one call gets the size, the sparse attribute, and the last-write time.
+
+    CPhaseTimer timeOpen( phaseOpen );
+    HANDLE h = CreateFile( pwc, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING, 0, 0 );
+    if ( INVALID_HANDLE_VALUE != h )
+    {
+        XHandle xh( h );
+        BY_HANDLE_FILE_INFORMATION info;
+        if ( GetFileInformationByHandle( h, &info ) )
+        {
+            LARGE_INTEGER fileSize;
+            fileSize.QuadPart = ( ( (long long) info.nFileSizeHigh ) << 32 ) | info.nFileSizeLow;
+            long long zeroLen = 0;
+            bool checked = true;
+
+            if ( 0 != fileSize.QuadPart )
+            {
+                LONG toCheck = (LONG) get_min( fileSize.QuadPart, tailLen );
+                LONG toRead = (LONG) ( tail_data_end( h, fileSize.QuadPart, toCheck, info.dwFileAttributes ) - ( fileSize.QuadPart - toCheck ) );
+                timeOpen.Complete();
+
+                // data that ends before EOF is followed by a hole, which is a zero tail without reading
+
+                if ( toRead < toCheck )
+                {
+                    zeroLen = toCheck - toRead;
+                    report_zero_tail( pwc, fileSize.QuadPart, zeroLen, tailHole );
+                }
+                else
+                {
+                    checked = false;
+                    CPhaseTimer timeRead( phaseRead );
+                    LARGE_INTEGER seek;
+                    seek.QuadPart = -toCheck;
+                    if ( SetFilePointerEx( h, seek, 0, FILE_END ) )
+                    {
+                        DWORD dwRead = 0;
+                        BOOL ok = ReadFile( h, buf, toRead, &dwRead, 0 );
+                        DWORD dwerr = GetLastError();
+                        timeRead.Complete();
+                        count_read( dwRead );
+
+                        if ( ok )
+                        {
+                            checked = true;
+                            if ( ( 0 != dwRead ) && tail_is_zero( buf, dwRead ) )
+                            {
+                                zeroLen = dwRead;
+                                report_zero_tail( pwc, fileSize.QuadPart, zeroLen );
+                            }
+                        }
+                        else
+                            report_error( errRead, pwc, dwerr, toCheck, fileSize.QuadPart );
+                    }
+                    else
+                        report_error( errSeek, pwc, GetLastError(), toCheck, fileSize.QuadPart );
+                }
+            }
+
+            if ( checked && ( 0 != indexFile ) )
+                tail_to_index( pwc, fileSize.QuadPart, file_time( info.ftLastWriteTime ), zeroLen );
+        }
+        else
+            report_error( errLength, pwc, GetLastError(), 0 );
+    }
+    else
+    {
+        report_error( errOpen, pwc, GetLastError(), 0 );
+        return false;
+    }
+
+    return true;
+} //search_folder
+
+#else
+
+// Returns where the data in the tail window ends. Bytes past that are holes or unwritten (preallocated)
+// extents, which read as zeros, so the tail of a copy that preallocated its destination and then died
+// is found without reading anything. FIEMAP is a cheap local ioctl that also reports unwritten extents.
+// Delayed allocations (dirty data not yet on disk) are reported as DELALLOC extents, which count as data.
+// Unwritten extents may also have dirty pages FIEMAP doesn't know about, so a tail that looks unwritten
+// is confirmed with SEEK_DATA, which checks the page cache.
+// File systems without FIEMAP (tmpfs, for example) fall back to SEEK_DATA when st_blocks shows holes.
+// Not on network file systems, where each lseek is a synchronous round trip that would stall every probe
+// on an io_uring thread, and not on ZFS, where compression makes st_blocks look like holes for most files.
+
+// true if SEEK_DATA is cheap and meaningful on the file system holding dev. Answers are cached per thread.
+
+bool seek_data_worthwhile( int fd, dev_t dev )
+{
+    static const uint32_t slowTypes[] = { 0x6969 /* NFS */, 0x517b /* SMB */, 0xff534d42 /* CIFS */, 0xfe534d42 /* SMB2 */,
+                                          0x65735546 /* FUSE */, 0x01021997 /* 9P */, 0x00c36400 /* Ceph */, 0x5346414f /* AFS */,
+                                          0x73757245 /* Coda */, 0x47504653 /* GPFS */, 0x0bd00bd0 /* Lustre */, 0x2fc12fc1 /* ZFS */ };
+
+    struct DevAnswer { dev_t dev; bool worthwhile; };
+    static thread_local vector<DevAnswer> answers;
+
+    for ( size_t i = 0; i < answers.size(); i++ )
+        if ( dev == answers[ i ].dev )
+            return answers[ i ].worthwhile;
+
+    struct statfs sfs;
+    bool worthwhile = ( 0 == fstatfs( fd, &sfs ) );
+    for ( size_t t = 0; worthwhile && t < _countof( slowTypes ); t++ )
+        if ( (uint32_t) sfs.f_type == slowTypes[ t ] ) // f_type is signed on some architectures
+            worthwhile = false;
+
+    DevAnswer a = { dev, worthwhile };
+    answers.push_back( a );
+    return worthwhile;
+} //seek_data_worthwhile
+
+long long tail_data_end( int fd, dev_t dev, long long fileSize, long long toCheck, long long blocks )
+{
+    if ( !checkExtents )
+        return fileSize;
+
+    long long windowStart = fileSize - toCheck;
+    const unsigned maxExtents = 32;
+    uint64_t request[ ( sizeof( struct fiemap ) + maxExtents * sizeof( struct fiemap_extent ) ) / sizeof( uint64_t ) ];
+    struct fiemap * pfm = (struct fiemap *) request;
+    memset( pfm, 0, sizeof( struct fiemap ) );
+    pfm->fm_start = windowStart;
+    pfm->fm_length = toCheck;
+    pfm->fm_extent_count = maxExtents;
+
+    if ( 0 == ioctl( fd, FS_IOC_FIEMAP, pfm ) )
+    {
+        if ( 0 == pfm->fm_mapped_extents )
+            return windowStart;
+
+        struct fiemap_extent & last = pfm->fm_extents[ pfm->fm_mapped_extents - 1 ];
+        if ( ( maxExtents == pfm->fm_mapped_extents ) && ( 0 == ( last.fe_flags & FIEMAP_EXTENT_LAST ) ) )
+            return fileSize; // too fragmented to be worth more calls
+
+        long long dataEnd = windowStart;
+        bool unwritten = false;
+        for ( unsigned e = 0; e < pfm->fm_mapped_extents; e++ )
+        {
+            struct fiemap_extent & extent = pfm->fm_extents[ e ];
+            if ( 0 != ( extent.fe_flags & FIEMAP_EXTENT_UNWRITTEN ) )
+                unwritten = true;
+            else
+                dataEnd = get_max( dataEnd, (long long) ( extent.fe_logical + extent.fe_length ) );
+        }
+
+        dataEnd = get_min( dataEnd, fileSize );
+        if ( !unwritten || dataEnd >= fileSize )
+            return dataEnd;
+    }
+    else if ( ( ( blocks * 512 ) >= fileSize ) || !seek_data_worthwhile( fd, dev ) )
+        return fileSize;
+
+    long long dataEnd = windowStart;
+    for ( long long pos = windowStart; pos < fileSize; )
+    {
+        off_t data = lseek( fd, pos, SEEK_DATA );
+        if ( data < 0 )
+            return ( ENXIO == errno ) ? dataEnd : fileSize;
+
+        off_t hole = lseek( fd, data, SEEK_HOLE );
+        if ( hole < 0 )
+            return fileSize;
+
+        dataEnd = get_min( (long long) hole, fileSize );
+        pos = hole;
+    }
+
+    return dataEnd;
+} //tail_data_end
+
+uint64_t file_time( const struct timespec & ts ) { return ( (uint64_t) ts.tv_sec ) * 1000000000 + ts.tv_nsec; }
+uint64_t file_time( const struct statx_timestamp & ts ) { return ( (uint64_t) ts.tv_sec ) * 1000000000 + ts.tv_nsec; }
+
+// returns false if the file couldn't be opened, so a deep scan doesn't report the same error
+
+bool search_folder( const pathchar * pc )
+{
+    assert( tailLen <= maxTailLen );
+    assert( tailLen >= 1 );
+
+    if ( 0 != indexFile )
+    {
+        struct stat st;
+        if ( 0 == stat( pc, &st ) && tail_from_index( pc, st.st_size, file_time( st.st_mtim ) ) )
+            return true;
+    }
+
+    CPooledBuffer pooled( g_buffers );
+    uint8_t * buf = pooled.Get();
+    if ( 0 == buf )
+    {
+        report_error( errRead, pc, ENOMEM, tailLen );
+        return true;
+    }
+
+    // the open phase covers opening and the size and extent queries
+
+    CPhaseTimer timeOpen( phaseOpen );
+    int fd = open( pc, O_RDONLY | O_CLOEXEC );
+    if ( -1 != fd )
+    {
+        XFd xfd( fd );
+        struct stat st;
+        if ( 0 == fstat( fd, &st ) )
+        {
+            long long zeroLen = 0;
+            ssize_t result = 0;
+
+            if ( 0 != st.st_size )
+            {
+                long long toCheck = get_min( (long long) st.st_size, tailLen );
+                long long toRead = tail_data_end( fd, st.st_dev, st.st_size, toCheck, st.st_blocks ) - ( st.st_size - toCheck );
+                long long cbRead = 0;
+                timeOpen.Complete();
+
+                // data that ends before EOF is followed by a hole, which is a zero tail without reading
+
+                if ( toRead < toCheck )
+                {
+                    zeroLen = toCheck - toRead;
+                    report_zero_tail( pc, st.st_size, zeroLen, tailHole );
+                }
+                else
+                {
+                    // large windows may come back in pieces on network file systems
+
+                    CPhaseTimer timeRead( phaseRead );
+                    while ( cbRead < toRead )
+                    {
+                        result = pread( fd, buf + cbRead, toRead - cbRead, st.st_size - toCheck + cbRead );
+                        if ( result <= 0 )
+                            break;
+                        cbRead += result;
+                    }
+                    timeRead.Complete();
+                    count_read( cbRead );
+
+                    if ( result >= 0 )
+                    {
+                        if ( ( 0 != cbRead ) && tail_is_zero( buf, cbRead ) )
+                        {
+                            zeroLen = cbRead;
+                            report_zero_tail( pc, st.st_size, zeroLen );
+                        }
+                    }
+                    else
+                        report_error( errRead, pc, errno, toCheck, st.st_size );
+                }
+            }
+
+            if ( result >= 0 )
+                tail_to_index( pc, st.st_size, file_time( st.st_mtim ), zeroLen );
+        }
+        else
+            report_error( errLength, pc, errno, 0 );
+    }
+    else
+    {
+        report_error( errOpen, pc, errno, 0 );
+        return false;
+    }
+
+    return true;
+} //search_folder
+
+// Checks tails with io_uring: each slot opens and statx's a file concurrently, then reads the tail, then closes it.
+// Slots are refilled as soon as they free up so the device queue stays full rather than draining between batches.
+// With an -i index the statx goes first, alone, so unchanged files are never opened.
+
+class CTailProber
+{
+    private:
+        enum SlotState { slotFree, slotStatting, slotOpening, slotReading, slotClosing };
+        enum OpKind { opOpen, opStatx, opRead, opClose };
+
+        struct Slot
+        {
+            const pathchar * path;
+            SlotState state;
+            int pending;           // completions outstanding for the current state
+            int fd;
+            int statError;
+            bool reported;         // an error was already reported for the file
+            long long toCheck;     // the tail window
+            long long toRead;      // the part of the window that has data
+            long long cbRead;
+            struct statx stx;
+            uint8_t * buf;
+            steady_clock::time_point started;   // of the current phase, while benchmarking
+        };
+
+        CIoUring ring;
+        vector<Slot> slots;
+        vector<unsigned> freeSlots;
+        unsigned busy;
+
+        static uint64_t UserData( unsigned slot, OpKind op ) { return ( ( (uint64_t) slot ) << 2 ) | op; }
+
+        io_uring_sqe * GetSqe()
+        {
+            io_uring_sqe * sqe = ring.GetSqe();
+            while ( 0 == sqe )
+            {
+                ring.Submit( 0 );
+                sqe = ring.GetSqe();
+            }
+            return sqe;
+        } //GetSqe
+
+        void StartOpen( unsigned s, const pathchar * path )
+        {
+            Slot & slot = slots[ s ];
+            slot.path = path;
+            slot.fd = -1;
+            slot.statError = 0;
+            slot.reported = false;
+            busy++;
+            if ( timingPhases )
+                slot.started = steady_clock::now();
+
+            if ( 0 != indexFile )
+            {
+                slot.state = slotStatting;
+                slot.pending = 1;
+                CIoUring::PrepStatx( GetSqe(), AT_FDCWD, path, 0, STATX_SIZE | STATX_BLOCKS | STATX_MTIME, &slot.stx, UserData( s, opStatx ) );
+                return;
+            }
+
+            slot.state = slotOpening;
+            slot.pending = 2;
+
+            // statx by path rather than by fd so both operations are in flight at once
+
+            CIoUring::PrepOpenAt( GetSqe(), AT_FDCWD, path, O_RDONLY | O_CLOEXEC, 0, UserData( s, opOpen ) );
+            CIoUring::PrepStatx( GetSqe(), AT_FDCWD, path, 0, STATX_SIZE | STATX_BLOCKS | STATX_MTIME, &slot.stx, UserData( s, opStatx ) );
+        } //StartOpen
+
+        void StartClose( unsigned s )
+        {
+            Slot & slot = slots[ s ];
+            slot.state = slotClosing;
+            slot.pending = 1;
+            CIoUring::PrepClose( GetSqe(), slot.fd, UserData( s, opClose ) );
+        } //StartClose
+
+        void Release( unsigned s )
+        {
+            slots[ s ].state = slotFree;
+            freeSlots.push_back( s );
+            busy--;
+        } //Release
+
+        // returns true if the slot was released and its path is no longer needed
+
+        bool Complete( uint64_t userData, int result )
+        {
+            unsigned s = (unsigned) ( userData >> 2 );
+            OpKind op = (OpKind) ( userData & 3 );
+            Slot & slot = slots[ s ];
+
+            if ( slotStatting == slot.state )
+            {
+                if ( ( result >= 0 ) && tail_from_index( slot.path, slot.stx.stx_size, file_time( slot.stx.stx_mtime ) ) )
+                {
+                    Release( s );
+                    return true;
+                }
+
+                // a failed statx is retried alongside the open so errors are reported as they are without an index
+
+                slot.state = slotOpening;
+                slot.pending = ( result >= 0 ) ? 1 : 2;
+                CIoUring::PrepOpenAt( GetSqe(), AT_FDCWD, slot.path, O_RDONLY | O_CLOEXEC, 0, UserData( s, opOpen ) );
+                if ( result < 0 )
+                    CIoUring::PrepStatx( GetSqe(), AT_FDCWD, slot.path, 0, STATX_SIZE | STATX_BLOCKS | STATX_MTIME, &slot.stx, UserData( s, opStatx ) );
+                return false;
+            }
+
+            if ( opOpen == op )
+            {
+                if ( result >= 0 )
+                    slot.fd = result;
+                else
+                {
+                    report_error( errOpen, slot.path, -result, 0 );
+                    slot.reported = true;
+                }
+            }
+            else if ( opStatx == op )
+            {
+                if ( result < 0 )
+                    slot.statError = -result;
+            }
+            else if ( opRead == op )
+            {
+                if ( ( result > 0 ) && ( ( slot.cbRead += result ) < slot.toRead ) )
+                {
+                    // a short read; ask for the rest of the window
+
+                    long long offset = slot.stx.stx_size - slot.toCheck + slot.cbRead;
+                    CIoUring::PrepRead( GetSqe(), slot.fd, slot.buf + slot.cbRead, (unsigned) ( slot.toRead - slot.cbRead ), offset, UserData( s, opRead ) );
+                    return false;
+                }
+
+                if ( timingPhases )
+                {
+                    record_phase( phaseRead, slot.started );
+                    count_read( slot.cbRead );
+                }
+
+                if ( result < 0 )
+                    report_error( errRead, slot.path, -result, slot.toCheck, slot.stx.stx_size );
+                else
+                {
+                    long long zeroLen = 0;
+                    if ( ( 0 != slot.cbRead ) && tail_is_zero( slot.buf, slot.cbRead ) )
+                    {
+                        zeroLen = slot.cbRead;
+                        report_zero_tail( slot.path, slot.stx.stx_size, zeroLen );
+                    }
+                    tail_to_index( slot.path, slot.stx.stx_size, file_time( slot.stx.stx_mtime ), zeroLen );
+                }
+            }
+
+            if ( 0 != --slot.pending )
+                return false;
+
+            if ( ( slotOpening == slot.state ) && timingPhases )
+                record_phase( phaseOpen, slot.started );
+
+            if ( slotOpening == slot.state )
+            {
+                if ( -1 == slot.fd )
+                {
+                    Release( s );
+                    return true;
+                }
+                else if ( 0 != slot.statError )
+                {
+                    report_error( errLength, slot.path, slot.statError, 0 );
+                    StartClose( s );
+                }
+                else if ( 0 == slot.stx.stx_size )
+                {
+                    tail_to_index( slot.path, 0, file_time( slot.stx.stx_mtime ), 0 );
+                    StartClose( s );
+                }
+                else
+                {
+                    // the extent check is a synchronous ioctl, but it's answered from cached metadata
+
+                    long long size = slot.stx.stx_size;
+                    slot.toCheck = get_min( size, tailLen );
+                    slot.toRead = tail_data_end( slot.fd, makedev( slot.stx.stx_dev_major, slot.stx.stx_dev_minor ), size, slot.toCheck, slot.stx.stx_blocks ) - ( size - slot.toCheck );
+                    slot.cbRead = 0;
+
+                    if ( slot.toRead < slot.toCheck )
+                    {
+                        report_zero_tail( slot.path, size, slot.toCheck - slot.toRead, tailHole );
+                        tail_to_index( slot.path, size, file_time( slot.stx.stx_mtime ), slot.toCheck - slot.toRead );
+                        StartClose( s );
+                    }
+                    else
+                    {
+                        slot.state = slotReading;
+                        slot.pending = 1;
+                        if ( timingPhases )
+                            slot.started = steady_clock::now();
+                        CIoUring::PrepRead( GetSqe(), slot.fd, slot.buf, (unsigned) slot.toRead, size - slot.toCheck, UserData( s, opRead ) );
+                    }
+                }
+            }
+            else if ( slotReading == slot.state )
+                StartClose( s );
+            else
+            {
+                Release( s );
+                return true;
+            }
+
+            return false;
+        } //Complete
+
+        // Called when the ring can't be entered. Submitted requests can't be cancelled or waited for, and the
+        // kernel may still complete them: writing into slot.stx and slot.buf, reading a slot's path, and
+        // creating fds for opens. So slot memory, buffers, and the paths of opens and stats are leaked rather
+        // than freed. Files that weren't finished are checked again synchronously.
+
+        template <typename D> void Abandon( D done )
+        {
+            for ( size_t s = 0; s < slots.size(); s++ )
+            {
+                Slot & slot = slots[ s ];
+                if ( slotFree == slot.state )
+                    continue;
+
+                // a closing slot already reported its verdict. a close may be in flight, so its fd isn't touched
+
+                if ( slotClosing == slot.state )
+                {
+                    done( slot.path );
+                    continue;
+                }
+
+                if ( !slot.reported )
+                    search_folder( slot.path );
+
+                // a read in flight holds its own reference to the file, so closing the fd is safe
+
+                if ( -1 != slot.fd )
+                    close( slot.fd );
+
+                if ( slotReading == slot.state )
+                    done( slot.path );
+            }
+
+            new vector<Slot>( std::move( slots ) ); // leaked on purpose; see above
+            slots.clear();
+            freeSlots.clear();
+            busy = 0;
+        } //Abandon
+
+    public:
+        CTailProber() : busy( 0 ) {}
+
+        ~CTailProber()
+        {
+            for ( size_t s = 0; s < slots.size(); s++ )
+                g_buffers.Put( slots[ s ].buf );
+        }
+
+        // returns false if this kernel can't run the prober, in which case callers fall back to search_folder()
+
+        bool Init( unsigned depth )
+        {
+            if ( !ring.Init( 2 * depth ) )
+                return false;
+
+            static const uint8_t ops[] = { IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE };
+            if ( !ring.Supports( ops, _countof( ops ) ) )
+                return false;
+
+            slots.resize( depth );
+            freeSlots.reserve( depth );
+
+            for ( unsigned s = 0; s < depth; s++ )
+            {
+                slots[ s ].state = slotFree;
+                slots[ s ].buf = g_buffers.Get();
+                if ( 0 == slots[ s ].buf )
+                    return false;
+                freeSlots.push_back( depth - 1 - s );
+            }
+
+            return true;
+        } //Init
+
+        // next( wait ) returns the next path to check or 0 when there are no more. When wait is false it may
+        // also return 0 if no path is ready yet; the prober only waits for paths when it has no I/O in flight.
+        // done() is called with each path once the prober no longer references it.
+
+        template <typename N, typename D> void Run( N next, D done )
+        {
+            bool more = true;
+
+            do
+            {
+                while ( more && !freeSlots.empty() )
+                {
+                    bool wait = ( 0 == busy );
+                    const pathchar * path = next( wait );
+                    if ( 0 == path )
+                    {
+                        // without waiting, 0 may just mean the enumerator is behind. Reap completions and ask again.
+
+                        if ( wait )
+                            more = false;
+                        break;
+                    }
+
+                    unsigned s = freeSlots.back();
+                    freeSlots.pop_back();
+                    StartOpen( s, path );
+                }
+
+                if ( 0 == busy )
+                    break;
+
+                int result = ring.Submit( 1 );
+                if ( ( result < 0 ) && ( -EAGAIN != result ) && ( -EBUSY != result ) )
+                {
+                    // the ring is unusable. finish synchronously, re-checking files whose tails weren't read yet
+
+                    tracer.Trace( "io_uring_enter failed with error %d; falling back to pread\n", -result );
+                    Abandon( done );
+
+                    for ( const pathchar * path = next( true ); 0 != path; path = next( true ) )
+                    {
+                        search_folder( path );
+                        done( path );
+                    }
+                    return;
+                }
+
+                io_uring_cqe * cqe;
+                while ( 0 != ( cqe = ring.PeekCqe() ) )
+                {
+                    uint64_t userData = cqe->user_data;
+                    int res = cqe->res;
+                    ring.SeenCqe();
+                    if ( Complete( userData, res ) )
+                        done( slots[ userData >> 2 ].path );
+                }
+            } while ( true );
+        } //Run
+
+        static bool Available()
+        {
+            CTailProber prober;
+            return prober.Init( 1 );
+        } //Available
+}; //CTailProber
+
+#endif
+
+// Formats where long runs of zeros are normal: audio silence, disk images, and database and mail stores
+
+bool zeros_expected( const pathchar * p )
+{
+    static const char * extensions[] = { "wav", "aif", "aiff", "iso", "img", "dmg", "vhd", "vhdx", "vmdk", "vdi", "qcow2",
+                                         "mdf", "ldf", "ndf", "edb", "pst", "ost", "db", "sqlite" };
+
+    const pathchar * dot = path_rchr( p, '.' );
+    if ( 0 == dot || 0 != path_rchr( dot, PATH_SEP ) )
+        return false;
+
+    dot++;
+    for ( size_t e = 0; e < _countof( extensions ); e++ )
+    {
+        const char * ext = extensions[ e ];
+        size_t i = 0;
+        while ( 0 != ext[ i ] && ext[ i ] == path_lower( dot[ i ] ) )
+            i++;
+
+        if ( 0 == ext[ i ] && 0 == dot[ i ] )
+            return true;
+    }
+
+    return false;
+} //zeros_expected
+
+void report_zero_run( const pathchar * p, long long size, long long offset, long long length )
+{
+    deepRuns++;
+    add_result( p, resRun, 0, size, offset, length );
+} //report_zero_run
+
+// Finds runs of all-zero aligned blocks in data fed to it in file order
+
+class CZeroRunFinder
+{
+    private:
+        const pathchar * path;
+        long long size;
+        long long runStart;   // -1 when not in a run
+        size_t runs;
+
+    public:
+        CZeroRunFinder( const pathchar * p ) : path( p ), size( -1 ), runStart( -1 ), runs( 0 ) {}
+
+        void SetSize( long long fileSize ) { size = fileSize; }
+
+        // offset must be a multiple of deepBlock. Only the last chunk of a file may have a partial block.
+
+        void Add( const uint8_t * buf, size_t len, long long offset )
+        {
+            for ( size_t b = 0; b < len; b += deepBlock )
+            {
+                if ( tail_is_zero( buf + b, get_min( deepBlock, len - b ) ) )
+                {
+                    if ( -1 == runStart )
+                        runStart = offset + b;
+                }
+                else
+                    End( offset + b );
+            }
+        } //Add
+
+        // returns the number of runs found
+
+        size_t End( long long offset )
+        {
+            if ( ( -1 != runStart ) && ( offset - runStart >= deepRunLen ) )
+            {
+                report_zero_run( path, size, runStart, offset - runStart );
+                runs++;
+            }
+
+            runStart = -1;
+            return runs;
+        } //End
+}; //CZeroRunFinder
+
+// Reads a whole file in large sequential chunks looking for runs of zeros anywhere in it. The OS is told the
+// access is sequential so it reads ahead of the scan. A chunk can come back short, so the finder is only
+// handed whole blocks until the end of the file and a partial block is carried into the next chunk.
+
+void deep_scan( const pathchar * p )
+{
+    if ( zeros_expected( p ) )
+    {
+        deepSkipped++;
+        return;
+    }
+
+    CPooledBuffer pooled( g_deepBuffers );
+    uint8_t * buf = pooled.Get();
+    if ( 0 == buf )
+    {
+#ifdef _WIN32
+        report_error( errRead, p, ERROR_NOT_ENOUGH_MEMORY, deepChunk );
+#else
+        report_error( errRead, p, ENOMEM, deepChunk );
+#endif
+        return;
+    }
+
+    CZeroRunFinder finder( p );
+    long long offset = 0;
+    long long size = -1;
+    size_t cbBuf = 0;
+
+#ifdef _WIN32
+    HANDLE h = CreateFile( p, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0 );
+    if ( INVALID_HANDLE_VALUE == h )
+    {
+        report_error( errOpen, p, GetLastError(), 0 );
+        return;
+    }
+
+    XHandle xh( h );
+    LARGE_INTEGER fileSize;
+    if ( GetFileSizeEx( h, &fileSize ) )
+        size = fileSize.QuadPart;
+    finder.SetSize( size );
+
+    do
+    {
+        DWORD dwRead = 0;
+        CPhaseTimer timeRead( phaseRead );
+        BOOL ok = ReadFile( h, buf + cbBuf, (DWORD) ( deepChunk - cbBuf ), &dwRead, 0 );
+        DWORD dwerr = GetLastError();
+        timeRead.Complete();
+        count_read( dwRead );
+
+        if ( !ok )
+        {
+            report_error( errRead, p, dwerr, deepChunk, size );
+            break;
+        }
+
+        g_budget.Acquire( dwRead );
+
+        cbBuf += dwRead;
+        size_t cbWhole = ( 0 == dwRead ) ? cbBuf : cbBuf - ( cbBuf % deepBlock );
+        finder.Add( buf, cbWhole, offset );
+        offset += cbWhole;
+        memmove( buf, buf + cbWhole, cbBuf - cbWhole );
+        cbBuf -= cbWhole;
+
+        if ( 0 == dwRead )
+            break;
+    } while ( true );
+#else
+    int fd = open( p, O_RDONLY | O_CLOEXEC );
+    if ( -1 == fd )
+    {
+        report_error( errOpen, p, errno, 0 );
+        return;
+    }
+
+    XFd xfd( fd );
+    posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+
+    struct stat st;
+    if ( 0 == fstat( fd, &st ) )
+        size = st.st_size;
+    finder.SetSize( size );
+
+    do
+    {
+        CPhaseTimer timeRead( phaseRead );
+        ssize_t result = read( fd, buf + cbBuf, deepChunk - cbBuf );
+        timeRead.Complete();
+        count_read( result );
+
+        if ( result < 0 )
+        {
+            if ( EINTR == errno )
+                continue;
+            report_error( errRead, p, errno, deepChunk, size );
+            break;
+        }
+
+        // charged after the read so short reads cost what they read. The budget lags by at most one chunk.
+
+        g_budget.Acquire( result );
+
+        cbBuf += result;
+        size_t cbWhole = ( 0 == result ) ? cbBuf : cbBuf - ( cbBuf % deepBlock );
+        finder.Add( buf, cbWhole, offset );
+        offset += cbWhole;
+        memmove( buf, buf + cbWhole, cbBuf - cbWhole );
+        cbBuf -= cbWhole;
+
+        if ( 0 == result )
+            break;
+    } while ( true );
+#endif
+
+    if ( 0 != finder.End( offset ) )
+        deepFiles++;
+} //deep_scan
+
+// checks the tail of one file and, with -d, everything before it
+
+void check_file( const pathchar * p )
+{
+    if ( search_folder( p ) && ( 0 != deepRunLen ) )
+        deep_scan( p );
+} //check_file
+
+template <typename T> void run_threads( unsigned threads, T func )
+{
+    vector<thread> workers;
+    for ( unsigned t = 0; t < threads; t++ )
+        workers.emplace_back( func );
+
+    for ( size_t t = 0; t < workers.size(); t++ )
+        workers[ t ].join();
+} //run_threads
+
+// Checks every path returned by next( wait ) until it returns 0 after waiting. With wait false, next() may return 0
+// when no path is ready yet. done() is called with each path once it's been checked.
+
+template <typename N, typename D> void check_parallel( N next, D done )
+{
+    unsigned cores = get_max( 1u, thread::hardware_concurrency() );
+
+    // deep scans stream whole files with blocking reads, so they use the thread pool
+
+#ifndef _WIN32
+    if ( !usePread && ( 0 == deepRunLen ) && CTailProber::Available() )
+    {
+        size_t depth = get_min( (size_t) uringDepth, uringBufferBudget / g_buffers.BufferSize() );
+        depth = get_max( (size_t) 1, depth );
+
+        run_threads( ( 0 != checkThreads ) ? checkThreads : get_min( uringMaxThreads, cores ), [&] ()
+        {
+            CTailProber prober;
+            if ( prober.Init( (unsigned) depth ) )
+                prober.Run( next, done );
+            else
+            {
+                for ( const pathchar * p = next( true ); 0 != p; p = next( true ) )
+                {
+                    search_folder( p );
+                    done( p );
+                }
+            }
+        } );
+        return;
+    }
+#endif
+
+    run_threads( ( 0 != checkThreads ) ? checkThreads : get_min( preadMaxThreads, 4 * cores ), [&] ()
+    {
+        for ( const pathchar * p = next( true ); 0 != p; p = next( true ) )
+        {
+            check_file( p );
+            done( p );
+        }
+    } );
+} //check_parallel
+
+// Spins briefly, then yields, then sleeps while a queue is full or empty
+
+void backoff( unsigned & attempt )
+{
+    if ( attempt++ < 64 )
+        this_thread::yield();
+    else
+        sleep_ms( 1 );
+} //backoff
+
+// Enumerates on one thread while the checkers drain a bounded queue, so checking starts right away and
+// memory use doesn't grow with the size of the tree. The count of files found so far is reported every
+// progressMS. Returns the number of files found.
+
+size_t stream_and_check( const pathchar * root )
+{
+    CBoundedQueue<pathchar *> queue( streamQueueSize );
+    atomic<bool> enumerationDone( false );
+    atomic<size_t> cPaths( 0 );
+    steady_clock::time_point started = steady_clock::now();
+    atomic<long long> lastProgress( 0 );   // ms after started
+
+    thread enumerator( [&] ()
+    {
+        CEnumFolder enumerate( true, [&] ( const pathchar * p )
+        {
+            pathchar * pdup = path_dup( p );
+            unsigned attempt = 0;
+            while ( !queue.TryPush( pdup ) )
+                backoff( attempt );
+            size_t count = ++cPaths;
+
+            // one enumerator thread wins the exchange and reports
+
+            long long now = duration_cast<milliseconds>( steady_clock::now() - started ).count();
+            long long last = lastProgress;
+            if ( ( now - last ) >= progressMS && lastProgress.compare_exchange_strong( last, now ) )
+                fprintf( infoOut, "looking at %zu files so far\n", count );
+        }, 0, 0 );
+
+        if ( 0 != enumThreads )
+            enumerate.SetThreadCount( enumThreads );
+        if ( timingPhases )
+            enumerate.SetFolderTimer( [] ( long long ns ) { g_phaseTimes[ phaseEnumerate ].Record( ns ); } );
+        enumerate.Enumerate( root, 0 );
+        enumerationDone = true;
+    } );
+
+    auto next = [&] ( bool wait ) -> const pathchar *
+    {
+        pathchar * p;
+        unsigned attempt = 0;
+
+        do
+        {
+            if ( queue.TryPop( p ) )
+                return p;
+
+            // every push happened before enumerationDone was set, so one more look is conclusive
+
+            if ( enumerationDone )
+                return queue.TryPop( p ) ? p : 0;
+
+            if ( !wait )
+                return 0;
+
+            backoff( attempt );
+        } while ( true );
+    };
+
+    check_parallel( next, [] ( const pathchar * p ) { delete [] p; } );
+    enumerator.join();
+
+    return cPaths;
+} //stream_and_check
+
+// Enumerates and checks every file under root. Returns the number of files found.
+
+size_t scan_tree( const pathchar * root, bool stream, bool parallel )
+{
+    if ( stream && parallel )
+    {
+        fprintf( infoOut, "looking at files in folder " PATH_FMT " as they are found\n", root );
+        start_output();
+        size_t cPaths = stream_and_check( root );
+        finish_output();
+        return cPaths;
+    }
+
+    // the store keeps each folder's path once and a file's leaf name, so huge trees fit in memory.
+    // full paths are built as files are checked.
+
+    CPathStore paths;
+    CEnumFolder enumerate( true, &paths, 0, 0 );
+    if ( 0 != enumThreads )
+        enumerate.SetThreadCount( enumThreads );
+    if ( timingPhases )
+        enumerate.SetFolderTimer( [] ( long long ns ) { g_phaseTimes[ phaseEnumerate ].Record( ns ); } );
+    enumerate.Enumerate( root, 0 );
+
+    size_t cPaths = paths.Count();
+    if ( 0 == cPaths )
+        return 0;
+
+    fprintf( infoOut, "looking at %zu files in folder " PATH_FMT "\n", cPaths, root );
+    start_output();
+
+    if ( parallel )
+    {
+        atomic<size_t> nextPath( 0 );
+        check_parallel( [&] ( bool ) -> const pathchar *
+        {
+            size_t i = nextPath++;
+            return ( i < cPaths ) ? paths.DupPath( i ) : 0;
+        }, [] ( const pathchar * p ) { delete [] p; } );
+    }
+    else
+    {
+        vector<pathchar> path;
+        for ( size_t i = 0; i < cPaths; i++ )
+        {
+            const CPathStore::Node * node = paths.GetNode( i );
+            path.resize( CPathStore::PathLength( node ) + 1 );
+            CPathStore::GetPath( node, path.data(), path.size() );
+            check_file( path.data() );
+        }
+    }
+
+    finish_output();
+    return cPaths;
+} //scan_tree
+
+typedef basic_string<pathchar> pathstring;
+
+// arguments are ASCII, so WCHAR arguments are narrowed a character at a time
+
+string narrow_arg( const pathchar * p )
+{
+    string s;
+    for ( ; 0 != *p; p++ )
+        s += (char) *p;
+    return s;
+} //narrow_arg
+
+pathstring path_from_ascii( const char * p )
+{
+    pathstring s;
+    for ( ; 0 != *p; p++ )
+        s += (pathchar) *p;
+    return s;
+} //path_from_ascii
+
+// parses a byte count like 4096, 64k, or 2m
+
+long long parse_size( const char * p, const char ** end )
+{
+    char * suffix;
+    long long value = strtoll( p, &suffix, 10 );
+
+    if ( 'k' == *suffix || 'K' == *suffix )
+        value *= 1024, suffix++;
+    else if ( 'm' == *suffix || 'M' == *suffix )
+        value *= 1024 * 1024, suffix++;
+    else if ( 'g' == *suffix || 'G' == *suffix )
+        value *= 1024 * 1024 * 1024, suffix++;
+
+    *end = suffix;
+    return value;
+} //parse_size
+
+struct TreeSpec
+{
+    unsigned depth;          // levels of folders below the root
+    unsigned fanout;         // subfolders in each folder
+    size_t files;            // spread evenly at random over every folder including the root
+    long long minSize;       // sizes are log-uniform between these, like real trees: mostly small files
+    long long maxSize;
+    double zeroFraction;     // of files whose last 64k (or tail length, if larger) is zero
+};
+
+// parses e.g. depth=3,fanout=4,files=10000,size=1k-1m,zero=0.01. Fields can be in any order or left out.
+
+bool parse_tree_spec( const string & text, TreeSpec & spec )
+{
+    spec.depth = 3;
+    spec.fanout = 4;
+    spec.files = 10000;
+    spec.minSize = 1024;
+    spec.maxSize = 1024 * 1024;
+    spec.zeroFraction = 0.01;
+
+    const char * p = text.c_str();
+    while ( 0 != *p )
+    {
+        const char * eq = strchr( p, '=' );
+        if ( 0 == eq )
+            return false;
+
+        string key( p, eq - p );
+        const char * value = eq + 1;
+        const char * end = value;
+
+        if ( "depth" == key )
+            spec.depth = (unsigned) strtoul( value, (char **) &end, 10 );
+        else if ( "fanout" == key )
+            spec.fanout = (unsigned) strtoul( value, (char **) &end, 10 );
+        else if ( "files" == key )
+            spec.files = (size_t) strtoull( value, (char **) &end, 10 );
+        else if ( "zero" == key )
+            spec.zeroFraction = strtod( value, (char **) &end );
+        else if ( "size" == key )
+        {
+            spec.minSize = parse_size( value, &end );
+            spec.maxSize = spec.minSize;
+            if ( '-' == *end )
+                spec.maxSize = parse_size( end + 1, &end );
+        }
+        else
+            return false;
+
+        if ( end == value || ( ',' != *end && 0 != *end ) )
+            return false;
+
+        p = ( ',' == *end ) ? end + 1 : end;
+    }
+
+    return ( spec.depth <= 16 && spec.fanout >= 1 && spec.minSize >= 0 && spec.maxSize >= spec.minSize &&
+             spec.maxSize <= 256 * 1024 * 1024 && spec.zeroFraction >= 0.0 && spec.zeroFraction <= 1.0 );
+} //parse_tree_spec
+
+bool make_folder( const pathstring & p )
+{
+#ifdef _WIN32
+    return CreateDirectoryW( p.c_str(), 0 ) || ( ERROR_ALREADY_EXISTS == GetLastError() );
+#else
+    return ( 0 == mkdir( p.c_str(), 0755 ) ) || ( EEXIST == errno );
+#endif
+} //make_folder
+
+// true if p is a folder with nothing in it. false if it has entries, isn't a folder, or can't be read.
+
+bool folder_is_empty( const pathstring & p )
+{
+#ifdef _WIN32
+    pathstring spec( p );
+    if ( PATH_SEP != spec.back() )
+        spec += PATH_SEP;
+    spec += L'*';
+
+    WIN32_FIND_DATA fd;
+    HANDLE hFind = FindFirstFile( spec.c_str(), &fd );
+    if ( INVALID_HANDLE_VALUE == hFind )
+        return false;
+
+    bool empty = true;
+    do
+    {
+        if ( wcscmp( fd.cFileName, L"." ) && wcscmp( fd.cFileName, L".." ) )
+            empty = false;
+    } while ( empty && FindNextFile( hFind, &fd ) );
+
+    FindClose( hFind );
+    return empty;
+#else
+    DIR * dir = opendir( p.c_str() );
+    if ( 0 == dir )
+        return false;
+
+    bool empty = true;
+    struct dirent * pent;
+    while ( empty && 0 != ( pent = readdir( dir ) ) )
+        if ( strcmp( pent->d_name, "." ) && strcmp( pent->d_name, ".." ) )
+            empty = false;
+
+    closedir( dir );
+    return empty;
+#endif
+} //folder_is_empty
+
+bool write_file( const pathstring & p, const uint8_t * data, size_t cbData, size_t cbZeros, const uint8_t * zeros )
+{
+#ifdef _WIN32
+    FILE * fp = _wfopen( p.c_str(), L"wb" );
+#else
+    FILE * fp = fopen( p.c_str(), "wb" );
+#endif
+    if ( 0 == fp )
+        return false;
+
+    bool ok = ( ( 0 == cbData ) || ( 1 == fwrite( data, cbData, 1, fp ) ) ) &&
+              ( ( 0 == cbZeros ) || ( 1 == fwrite( zeros, cbZeros, 1, fp ) ) );
+    return ( 0 == fclose( fp ) ) && ok;
+} //write_file
+
+// Builds a reproducible tree for benchmarking. The same spec always produces the same files.
+// root must not exist or be an empty folder so existing files are never overwritten.
+
+bool generate_tree( const pathchar * root, const TreeSpec & spec )
+{
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    auto rand64 = [&] () -> uint64_t
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 2685821657736338717ull;
+    };
+    auto rand01 = [&] () -> double { return ( rand64() >> 11 ) * ( 1.0 / 9007199254740992.0 ); };
+
+    pathstring rootPath( root );
+    if ( !make_folder( rootPath ) )
+    {
+        printf( "can't create folder " PATH_FMT "\n", root );
+        return false;
+    }
+
+    if ( !folder_is_empty( rootPath ) )
+    {
+        printf( PATH_FMT " already exists and isn't an empty folder; -g only creates new trees\n", root );
+        return false;
+    }
+
+    if ( PATH_SEP != rootPath.back() )
+        rootPath += PATH_SEP;
+
+    vector<pathstring> folders( 1, rootPath );
+    size_t levelStart = 0;
+    char name[ 32 ];
+
+    for ( unsigned level = 0; level < spec.depth; level++ )
+    {
+        size_t levelEnd = folders.size();
+        for ( size_t f = levelStart; f < levelEnd; f++ )
+        {
+            for ( unsigned c = 0; c < spec.fanout; c++ )
+            {
+                snprintf( name, sizeof name, "d%u", c );
+                pathstring folder = folders[ f ] + path_from_ascii( name );
+                if ( !make_folder( folder ) )
+                {
+                    printf( "can't create folder " PATH_FMT "\n", folder.c_str() );
+                    return false;
+                }
+                folders.push_back( folder + PATH_SEP );
+            }
+        }
+        levelStart = levelEnd;
+    }
+
+    // every byte of data is non-zero so only the files meant to have zero tails do
+
+    vector<uint8_t> data( (size_t) spec.maxSize );
+    for ( size_t i = 0; i < data.size(); i++ )
+        data[ i ] = (uint8_t) ( rand64() | 1 );
+
+    long long zeroTail = get_max( tailLen, 64LL * 1024 );
+    vector<uint8_t> zeros( (size_t) get_min( zeroTail, spec.maxSize ) );
+
+    double logMin = log( (double) get_max( 1LL, spec.minSize ) );
+    double logMax = log( (double) get_max( 1LL, spec.maxSize ) );
+    size_t zeroFiles = 0;
+    long long totalBytes = 0;
+
+    for ( size_t i = 0; i < spec.files; i++ )
+    {
+        long long size = (long long) exp( logMin + rand01() * ( logMax - logMin ) );
+        size = get_min( get_max( size, spec.minSize ), spec.maxSize );
+        bool zero = ( 0 != size ) && ( rand01() < spec.zeroFraction );
+        long long cbZeros = zero ? get_min( size, zeroTail ) : 0;
+
+        snprintf( name, sizeof name, "f%zu.dat", i );
+        pathstring file = folders[ rand64() % folders.size() ] + path_from_ascii( name );
+        if ( !write_file( file, data.data(), (size_t) ( size - cbZeros ), (size_t) cbZeros, zeros.data() ) )
+        {
+            printf( "can't write file " PATH_FMT "\n", file.c_str() );
+            return false;
+        }
+
+        zeroFiles += zero;
+        totalBytes += size;
+    }
+
+    printf( "generated %zu files, %zu with zero tails, %.1f MB in %zu folders under " PATH_FMT "\n",
+            spec.files, zeroFiles, (double) totalBytes / ( 1024.0 * 1024.0 ), folders.size(), root );
+    return true;
+} //generate_tree
+
+// Peak resident memory in KB. On Linux the peak is reset between runs; Windows can only report it since startup.
+
+long long peak_rss_kb()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if ( GetProcessMemoryInfo( GetCurrentProcess(), &pmc, sizeof pmc ) )
+        return (long long) ( pmc.PeakWorkingSetSize / 1024 );
+    return 0;
+#else
+    FILE * fp = fopen( "/proc/self/status", "r" );
+    if ( 0 == fp )
+        return 0;
+
+    char line[ 256 ];
+    long long kb = 0;
+    while ( fgets( line, sizeof line, fp ) )
+        if ( 0 == strncmp( line, "VmHWM:", 6 ) )
+            kb = strtoll( line + 6, 0, 10 );
+
+    fclose( fp );
+    return kb;
+#endif
+} //peak_rss_kb
+
+// Frees the pooled buffers left by earlier runs so they don't count toward the next run's peak.
+// Call when no scan is running.
+
+void reset_peak_rss()
+{
+    g_buffers.Clear();
+    g_deepBuffers.Clear();
+
+#ifndef _WIN32
+    malloc_trim( 0 ); // freed buffers below the mmap threshold stay resident in the heap otherwise
+
+    int fd = open( "/proc/self/clear_refs", O_WRONLY | O_CLOEXEC );
+    if ( -1 != fd )
+    {
+        if ( 1 != write( fd, "5", 1 ) )
+            tracer.Trace( "can't reset peak rss, error %d\n", errno );
+        close( fd );
+    }
+#endif
+} //reset_peak_rss
+
+void reset_counters()
+{
+    found = 0;
+    foundInMetadata = 0;
+    deepRuns = 0;
+    deepFiles = 0;
+    deepSkipped = 0;
+    bytesRead = 0;
+
+    for ( int p = 0; p < phaseCount; p++ )
+        g_phaseTimes[ p ].Clear();
+} //reset_counters
+
+// Scans root with each engine and thread count and reports throughput, per-phase latencies, and peak memory.
+// A first untimed pass warms the cache so every run starts from the same state.
+
+// Drops a file's data from the OS cache so the next read goes to the device. Dirty data is written first
+// since it can't be dropped. On Windows a noncached open purges the file's cached data.
+
+void evict_file( const pathchar * p )
+{
+#ifdef _WIN32
+    HANDLE h = CreateFile( p, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, 0 );
+    if ( INVALID_HANDLE_VALUE != h )
+        CloseHandle( h );
+#else
+    int fd = open( p, O_RDONLY | O_CLOEXEC );
+    if ( -1 != fd )
+    {
+        fdatasync( fd );
+        posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+        close( fd );
+    }
+#endif
+} //evict_file
+
+void evict_tree( CPathStore & paths )
+{
+    vector<pathchar> path;
+    for ( size_t i = 0; i < paths.Count(); i++ )
+    {
+        const CPathStore::Node * node = paths.GetNode( i );
+        path.resize( CPathStore::PathLength( node ) + 1 );
+        CPathStore::GetPath( node, path.data(), path.size() );
+        evict_file( path.data() );
+    }
+} //evict_tree
+
+// cold evicts the tree's file data from the cache before each run, so reads go to the device as they would
+// on a first pass over a share. Folder metadata stays cached either way.
+
+void benchmark( const pathchar * root, const vector<unsigned> & threadCounts, bool cold )
+{
+    struct Engine { const char * name; bool stream; bool parallel; bool pread; };
+    static const Engine engines[] =
+    {
+#ifdef _WIN32
+        { "readfile", false, true, true },
+#else
+        { "io_uring", false, true, false },
+        { "pread", false, true, true },
+#endif
+        { "stream", true, true, false },
+        { "serial", false, false, true },
+    };
+    static const char * phaseNames[] = { "enumerate", "open", "read", "zero", "output" };
+
+#ifdef _WIN32
+    resultOut = fopen( "NUL", "w" );
+#else
+    resultOut = fopen( "/dev/null", "w" );
+    bool uringAvailable = CTailProber::Available();
+#endif
+    if ( 0 == resultOut )
+    {
+        printf( "can't open the null device\n" );
+        return;
+    }
+
+    FILE * info = infoOut;
+    infoOut = resultOut;
+    indexFile = 0;
+
+    size_t cPaths = scan_tree( root, false, true );
+
+    CPathStore coldPaths;
+    if ( cold )
+    {
+        CEnumFolder enumerate( true, &coldPaths, 0, 0 );
+        enumerate.Enumerate( root, 0 );
+    }
+
+    fprintf( info, "benchmarking %zu files in " PATH_FMT " with a %s. latencies are p50/p99 in microseconds\n\n", cPaths, root,
+             cold ? "cold cache: file data is evicted before each run" : "warm cache: an untimed pass ran first" );
+    fprintf( info, "engine   threads     files   found   seconds     files/s      MB/s  peak MB\n" );
+
+    timingPhases = true;
+
+    for ( size_t e = 0; e < _countof( engines ); e++ )
+    {
+        const Engine & engine = engines[ e ];
+
+#ifndef _WIN32
+        if ( !engine.pread && !uringAvailable )
+            continue;
+        usePread = engine.pread;
+#endif
+
+        for ( size_t t = 0; t < threadCounts.size(); t++ )
+        {
+            unsigned threads = engine.parallel ? threadCounts[ t ] : 1;
+            if ( !engine.parallel && 0 != t )
+                break;
+
+            checkThreads = threads;
+            enumThreads = threads;
+            if ( cold )
+                evict_tree( coldPaths );
+            reset_counters();
+            reset_peak_rss();
+
+            steady_clock::time_point start = steady_clock::now();
+            cPaths = scan_tree( root, engine.stream, engine.parallel );
+            double seconds = duration_cast<nanoseconds>( steady_clock::now() - start ).count() / 1000000000.0;
+            seconds = get_max( seconds, 0.000001 );
+
+            fprintf( info, "%-8s %7u %9zu %7zu %9.3f %11.0f %9.1f %8.1f\n", engine.name, threads, cPaths, (size_t) found, seconds,
+                     cPaths / seconds, bytesRead / ( 1024.0 * 1024.0 ) / seconds, peak_rss_kb() / 1024.0 );
+
+            string latencies( "        " );
+            for ( int p = 0; p < phaseCount; p++ )
+            {
+                CLatencyHistogram & h = g_phaseTimes[ p ];
+                if ( 0 == h.Count() )
+                    append_format( latencies, "  %s -", phaseNames[ p ] );
+                else
+                    append_format( latencies, "  %s %.1f/%.1f", phaseNames[ p ], h.Percentile( 0.5 ) / 1000.0, h.Percentile( 0.99 ) / 1000.0 );
+            }
+            fprintf( info, "%s\n", latencies.c_str() );
+        }
+    }
+
+    timingPhases = false;
+    fclose( resultOut );
+    resultOut = stdout;
+    infoOut = info;
+} //benchmark
+
+// parses the X in arguments of the form -a:X
+
+long long arg_value( const pathchar * arg, const char * what, long long minValue, long long maxValue )
+{
+    if ( ':' != arg[2] )
+    {
+        printf( "missing colon in %s argument\n", what );
+        usage();
+    }
+
+    long long value = path_to_ull( arg + 3 );
+
+    const pathchar * suffix = arg + 3;
+    while ( *suffix >= '0' && *suffix <= '9' )
+        suffix++;
+
+    if ( 'k' == *suffix || 'K' == *suffix )
+        value *= 1024;
+    else if ( 'm' == *suffix || 'M' == *suffix )
+        value *= 1024 * 1024;
+
+    if ( value < minValue || value > maxValue )
+    {
+        printf( "invalid %s specified: %lld\n", what, value );
+        usage();
+    }
+
+    return value;
+} //arg_value
+
+#ifdef _WIN32
+int wmain( int argc, WCHAR * argv[] )
+#else
+int main( int argc, char * argv[] )
+#endif
+{
+    pathchar * path = (pathchar *) PATH_TEXT( "." );
+    bool pathGiven = false;
+    bool parallel = true;
+    bool stream = false;
+    const pathchar * treeSpec = 0;
+    bool bench = false;
+    bool benchCold = false;
+    vector<unsigned> benchThreads;
+
+    for ( int i = 1; i < argc; i++ )
+    {
+#ifdef _WIN32
+        if ( '-' == argv[i][0] || '/' == argv[i][0] )
+#else
+        if ( '-' == argv[i][0] )
+#endif
+        {
+            pathchar a = argv[i][1];
+
+            if ( 'a' == a )
+                checkExtents = false;
+            else if ( 'b' == a )
+                g_budget.SetRate( arg_value( argv[i], "deep scan bytes per second", 1, 1LL << 40 ) );
+            else if ( 'c' == a )
+                checkThreads = (unsigned) arg_value( argv[i], "check thread count", 1, maxThreads );
+            else if ( 'd' == a )
+            {
+                if ( 0 == argv[i][2] )
+                    deepRunLen = deepDefaultRunLen;
+                else
+                    deepRunLen = round_up( arg_value( argv[i], "deep scan zero run length", 1, deepMaxRunLen ), (long long) deepBlock );
+            }
+            else if ( 'e' == a )
+                enumThreads = (unsigned) arg_value( argv[i], "enumeration thread count", 1, maxThreads );
+            else if ( 'g' == a )
+            {
+                if ( ':' != argv[i][2] )
+                {
+                    printf( "missing colon in tree generation argument\n" );
+                    usage();
+                }
+                treeSpec = argv[i] + 3;
+            }
+            else if ( 'i' == a )
+            {
+                if ( ':' != argv[i][2] || 0 == argv[i][3] )
+                {
+                    printf( "missing colon or file name in index argument\n" );
+                    usage();
+                }
+                indexFile = argv[i] + 3;
+            }
+            else if ( 'm' == a )
+                muteErrors = true;
+            else if ( 'o' == a )
+            {
+                const pathchar * format = ( ':' == argv[i][2] ) ? argv[i] + 3 : PATH_TEXT( "" );
+                if ( 0 == path_cmp( format, PATH_TEXT( "json" ) ) )
+                    outputFormat = outJson;
+                else if ( 0 == path_cmp( format, PATH_TEXT( "csv" ) ) )
+                    outputFormat = outCsv;
+                else if ( 0 == path_cmp( format, PATH_TEXT( "text" ) ) )
+                    outputFormat = outText;
+                else
+                {
+                    printf( "output format must be text, json, or csv\n" );
+                    usage();
+                }
+            }
+#ifndef _WIN32
+            else if ( 'p' == a )
+                usePread = true;
+#endif
+            else if ( 'q' == a )
+                stream = true;
+            else if ( 'r' == a )
+                sortOutput = true;
+            else if ( 's' == a )
+                parallel = false;
+            else if ( 't' == a )
+                tailLen = arg_value( argv[i], "tail length", 1, maxTailLen );
+            else if ( 'x' == a )
+            {
+                bench = true;
+                string list = ( ':' == argv[i][2] ) ? narrow_arg( argv[i] + 3 ) : string();
+                for ( const char * p = list.c_str(); 0 != *p; )
+                {
+                    if ( !strncmp( p, "cold", 4 ) && ( ',' == p[4] || 0 == p[4] ) )
+                    {
+                        benchCold = true;
+                        p += ( ',' == p[4] ) ? 5 : 4;
+                        continue;
+                    }
+
+                    char * end;
+                    unsigned long threads = strtoul( p, &end, 10 );
+                    if ( end == p || threads < 1 || threads > maxThreads || ( ',' != *end && 0 != *end ) )
+                    {
+                        printf( "invalid benchmark thread count list\n" );
+                        usage();
+                    }
+                    benchThreads.push_back( (unsigned) threads );
+                    p = ( ',' == *end ) ? end + 1 : end;
+                }
+
+                if ( benchThreads.empty() )
+                    benchThreads = { 1, 4, 16 };
+            }
+            else
+            {
+                printf( "invalid argument\n" );
+                usage();
+            }
+        }
+        else
+        {
+            path = argv[i];
+            pathGiven = true;
+        }
+    }
+
+    if ( 0 != treeSpec )
+    {
+        TreeSpec spec;
+        if ( !parse_tree_spec( narrow_arg( treeSpec ), spec ) )
+        {
+            printf( "invalid tree specification\n" );
+            usage();
+        }
+
+        // never generate into the current folder by default
+
+        if ( !pathGiven )
+        {
+            printf( "-g requires the path of a new or empty folder\n" );
+            usage();
+        }
+
+        if ( !generate_tree( path, spec ) )
+            return 1;
+
+        if ( !bench )
+            return 0;
+    }
+
+#ifdef _WIN32
+    WCHAR fullPath[ MAX_PATH ];
+    DWORD result = GetFullPathName( path, _countof( fullPath ), fullPath, 0 );
+    if ( 0 == result )
+    {
+        DWORD dwerr = GetLastError();
+        printf( "error %d %s -- unable to get full path for %ws\n", dwerr, ErrorString( dwerr ), path );
+        usage();
+    }
+
+    result = GetFileAttributes( fullPath );
+    if ( INVALID_FILE_ATTRIBUTES == result )
+    {
+        DWORD dwerr = GetLastError();
+        printf( "error %d %s -- can't find path %ws\n", dwerr, ErrorString( dwerr ), fullPath );
+        usage();
+    }
+
+    if ( ! ( result & FILE_ATTRIBUTE_DIRECTORY ) )
+    {
+        printf( "error -- path isn't a directory: %ws\n", fullPath );
+        usage();
+    }
+#else
+    char fullPath[ PATH_MAX ];
+    if ( 0 == realpath( path, fullPath ) )
+    {
+        int err = errno;
+        printf( "error %d %s -- can't find path %s\n", err, ErrorString( err ), path );
+        usage();
+    }
+
+    struct stat st;
+    if ( 0 != stat( fullPath, &st ) )
+    {
+        int err = errno;
+        printf( "error %d %s -- can't find path %s\n", err, ErrorString( err ), fullPath );
+        usage();
+    }
+
+    if ( !S_ISDIR( st.st_mode ) )
+    {
+        printf( "error -- path isn't a directory: %s\n", fullPath );
+        usage();
+    }
+#endif
+
+    g_buffers.SetBufferSize( (size_t) tailLen );
+    g_deepBuffers.SetBufferSize( deepChunk );
+
+    if ( outText != outputFormat )
+        infoOut = stderr;
+
+    if ( bench )
+    {
+        benchmark( fullPath, benchThreads, benchCold );
+        return 0;
+    }
+
+    // verdicts depend on the tail length and on whether holes count as zero tails, so an index saved
+    // with another -t or -a is ignored
+
+    if ( 0 != indexFile )
+    {
+        uint64_t tag = (uint64_t) tailLen | ( checkExtents ? 0 : ( 1ull << 32 ) );
+        if ( g_index.Load( indexFile, tag ) )
+            fprintf( infoOut, "using index " PATH_FMT " with %zu files\n", indexFile, g_index.LoadedCount() );
+        else
+            fprintf( infoOut, "index " PATH_FMT " doesn't exist or was saved with another -t, -a, or format; every file will be read\n", indexFile );
+    }
+
+    size_t cPaths = scan_tree( fullPath, stream, parallel );
+    if ( 0 == cPaths )
+    {
+        fprintf( infoOut, "no files found\n" );
+        usage();
+    }
+
+    fprintf( infoOut, "found %zu files with a zero tail out of %zu\n", (size_t) found, cPaths );
+    if ( 0 != foundInMetadata )
+        fprintf( infoOut, "  %zu of them were found from allocation metadata without reading data\n", (size_t) foundInMetadata );
+
+    if ( 0 != deepRunLen )
+        fprintf( infoOut, "deep scan found %zu zero runs of at least %lld bytes in %zu files. %zu files were skipped by type\n",
+                 (size_t) deepRuns, deepRunLen, (size_t) deepFiles, (size_t) deepSkipped );
+
+    if ( 0 != indexFile )
+    {
+        fprintf( infoOut, "%zu unchanged files were taken from the index and %zu new or changed files were read\n", (size_t) indexHits, (size_t) indexReads );
+        if ( !g_index.Save( indexFile ) )
+            fprintf( infoOut, "error -- can't save index " PATH_FMT "\n", indexFile );
+    }
+} //wmain